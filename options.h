@@ -9,4 +9,146 @@
 #define YAM_REG_LOAD_STORE_SPECIAL_HANDLING 1
 #endif
 
+/* Scale integer registers by mb_scale in integer arithmetic only, for
+ * targets without an FPU
+ */
+#ifndef YAM_REG_FIXED_POINT_SCALING
+#define YAM_REG_FIXED_POINT_SCALING 0
+#endif
+
+/* Support the four-register types _int64 and _uint64, and _double with
+ * YAM_REG_DOUBLE. Their 64-bit values grow each regval_t from 8 to 16
+ * octets, in every range buffer and store slot, so they're left out by
+ * default
+ */
+#ifndef YAM_REG_64BIT
+#define YAM_REG_64BIT 0
+#endif
+
+/* Support _double registers, they need double arithmetic, so they're
+ * left out by default with the fixed-point scaling
+ */
+#ifndef YAM_REG_DOUBLE
+#define YAM_REG_DOUBLE (YAM_REG_64BIT && ! YAM_REG_FIXED_POINT_SCALING)
+#endif
+
+#if YAM_REG_DOUBLE && ! YAM_REG_64BIT
+#error "YAM_REG_DOUBLE needs YAM_REG_64BIT"
+#endif
+
+/* Storage class of per-thread data, define it empty for single
+ * threaded targets without TLS support
+ */
+#ifndef YAM_THREAD_LOCAL
+#define YAM_THREAD_LOCAL __thread
+#endif
+
+/* Max number of register tables of a bank, including the .register
+ * section of the default bank
+ */
+#ifndef YAM_REG_TABLES_MAX
+#define YAM_REG_TABLES_MAX 8
+#endif
+
+/* Keep a pre-encoded modbus image of the registers published with
+ * yam_reg_publish(), for the refs in
+ * [YAM_REG_SHADOW_REF_FIRST, YAM_REG_SHADOW_REF_FIRST + YAM_REG_SHADOW_REF_NUM)
+ */
+#ifndef YAM_REG_SHADOW
+#define YAM_REG_SHADOW 0
+#endif
+
+#ifndef YAM_REG_SHADOW_REF_FIRST
+#define YAM_REG_SHADOW_REF_FIRST 40001
+#endif
+
+#ifndef YAM_REG_SHADOW_REF_NUM
+#define YAM_REG_SHADOW_REF_NUM 1024
+#endif
+
+/* Keep the first YAM_REG_BITS_COILS coils and
+ * YAM_REG_BITS_DISCRETE_INPUTS discrete inputs in a packed bit array
+ */
+#ifndef YAM_REG_BITS
+#define YAM_REG_BITS 0
+#endif
+
+#ifndef YAM_REG_BITS_COILS
+#define YAM_REG_BITS_COILS 2048
+#endif
+
+#ifndef YAM_REG_BITS_DISCRETE_INPUTS
+#define YAM_REG_BITS_DISCRETE_INPUTS 2048
+#endif
+
+/* Make each range read a consistent snapshot of the register bank,
+ * with a seqlock taken by the writers of the bank
+ */
+#ifndef YAM_REG_SNAPSHOT_READ
+#define YAM_REG_SNAPSHOT_READ 0
+#endif
+
+/* Track register changes for yam_reg_changes_since() */
+#ifndef YAM_REG_CHANGE_TRACKING
+#define YAM_REG_CHANGE_TRACKING 0
+#endif
+
+/* Cache values of read_cb registers by group policy, see regcache.h */
+#ifndef YAM_REG_CACHE
+#define YAM_REG_CACHE 0
+#endif
+
+/* Max number of registers with a cached value */
+#ifndef YAM_REG_CACHE_SLOTS
+#define YAM_REG_CACHE_SLOTS 64
+#endif
+
+/* Refreshing of a value stops when it's not read for this many max ages */
+#ifndef YAM_REG_CACHE_IDLE_AGES
+#define YAM_REG_CACHE_IDLE_AGES 8
+#endif
+
+/* Count reads, writes and errors of each register, with the time
+ * spent in its callbacks, for yam_reg_prof_top()
+ */
+#ifndef YAM_REG_PROFILE
+#define YAM_REG_PROFILE 0
+#endif
+
+/* Array registers, one descriptor for a block of elements, see reg_t */
+#ifndef YAM_REG_ARRAY
+#define YAM_REG_ARRAY 0
+#endif
+
+/* Register store in a memory-mapped file, see regstore_mmap.h, it
+ * needs a POSIX system
+ */
+#ifndef YAM_REGSTORE_MMAP
+#define YAM_REGSTORE_MMAP 0
+#endif
+
+/* Register store with a write-ahead journal, see regstore_journal.h,
+ * it needs a POSIX system with pthreads
+ */
+#ifndef YAM_REGSTORE_JOURNAL
+#define YAM_REGSTORE_JOURNAL 0
+#endif
+
+/* Record where each stage of a request begins and ends, see trace.h */
+#ifndef YAM_TRACE
+#define YAM_TRACE 0
+#endif
+
+/* Records in the trace ring of each thread, a power of two */
+#ifndef YAM_TRACE_RING_SIZE
+#define YAM_TRACE_RING_SIZE 4096
+#endif
+
+/* Timestamp of a trace record in nanoseconds, a uint64_t expression.
+ * The default reads CLOCK_MONOTONIC on POSIX systems and is 0 on the
+ * others, define it there, e.g., from a cycle counter or a timer */
+#ifndef YAM_TRACE_CLOCK
+#define YAM_TRACE_CLOCK() trace_clock_monotonic()
+#endif
+
 #endif /* __YAM_OPTIONS_H */
@@ -7,20 +7,23 @@
  *      INCLUDES
  *********************/
 #include <stddef.h>
+#include <string.h>
 #include "err.h"
 #include "filetype.h"
 #include "appl.h"
+#include "regbits.h"
+#include "trace.h"
 
 /**********************
  *      DEFINES
  **********************/
 #define REGISTER_SIZE   2
 #define COILS_PER_BYTE  8
+#define WRITE_COILS_MAX 1968
+#define READ_WRITE_REGS_READ_MAX    125
+#define READ_WRITE_REGS_WRITE_MAX   121
 
-#define COILS_REF_FIRST             1
-#define DISCRETE_INPUT_REF_FIRST    10001
-#define INPUT_REGS_REF_FIRST        30001
-#define HOLDING_REGS_REF_FIRST      40001
+#define FUNC_CODES                  128
 
 /**********************
  *      TYPEDEFS
@@ -35,26 +38,17 @@ typedef enum {
     ERR_ILLEGAL_DATA_VALUE,
 } mb_exception_t;
 
-typedef enum {
-    MBF_READ_COILS              = 1,
-    MBF_READ_DISCRETE_INPUTS    = 2,
-    MBF_WRITE_REG               = 6,
-    MBF_WRITE_REGS              = 16,
-    MBF_READ_HOLDING_REGS       = 3,
-    MBF_READ_FILE               = 20,
-    MBF_WRITE_FILE               = 21,
-} mb_func_t;
-
-typedef int (* mb_func_handler_t)(mb_func_t func,
-        const char *req_buf,
-        mb_size_t req_len,
-        char *resp_buf,
-        mb_size_t buf_sz);
 
+/**
+ * A range read once for a group of batched requests, see
+ * yam_app_input_batch().
+ */
 typedef struct {
-    mb_func_t func;
-    mb_func_handler_t handler;
-} mb_func_handler_map_t;
+    mb_ref_t start;
+    uint16_t count;
+    char heads[REG_RANGE_MAX + 1];
+    char buf[REG_RANGE_MAX * REGISTER_SIZE];
+} read_ahead_t;
 
 /**********************
  *  STATIC PROTOTYPES
@@ -64,6 +58,16 @@ static int read_coils_handler(mb_func_t func,
         mb_size_t req_len,
         char *resp_buf,
         mb_size_t buf_sz);
+static int write_coil_handler(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz);
+static int write_coils_handler(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz);
 static int read_holding_regs_handler(mb_func_t func,
         const char *req_buf,
         mb_size_t req_len,
@@ -79,6 +83,11 @@ static int write_regs_handlers(mb_func_t func,
         mb_size_t req_len,
         char *resp_buf,
         mb_size_t buf_sz);
+static int read_write_regs_handler(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz);
 static int read_file_handler(mb_func_t func,
         const char *req_buf,
         mb_size_t req_len,
@@ -93,37 +102,26 @@ static int write_file_handler(mb_func_t func,
 /**********************
  *  STATIC VARIABLES
  **********************/
-static const mb_func_handler_map_t func_handlers[] = {
-    {
-        .func = MBF_READ_COILS,
-        .handler = read_coils_handler,
-    },
-    {
-        .func = MBF_READ_DISCRETE_INPUTS,
-        .handler = read_coils_handler,
-    },
-    {
-        .func = MBF_READ_HOLDING_REGS,
-        .handler = read_holding_regs_handler,
-    },
-    {
-        .func = MBF_WRITE_REG,
-        .handler = write_regs_handler,
-    },
-    {
-        .func = MBF_WRITE_REGS,
-        .handler = write_regs_handlers,
-    },
-    {
-        .func = MBF_READ_FILE,
-        .handler = read_file_handler,
-    },
-    {
-        .func = MBF_WRITE_FILE,
-        .handler = write_file_handler,
-    },
+/* handler of each function code, indexed by the code */
+static mb_func_handler_t func_handlers[FUNC_CODES] = {
+    [MBF_READ_COILS] = read_coils_handler,
+    [MBF_READ_DISCRETE_INPUTS] = read_coils_handler,
+    [MBF_WRITE_COIL] = write_coil_handler,
+    [MBF_WRITE_COILS] = write_coils_handler,
+    [MBF_READ_HOLDING_REGS] = read_holding_regs_handler,
+    [MBF_WRITE_REG] = write_regs_handler,
+    [MBF_WRITE_REGS] = write_regs_handlers,
+    [MBF_READ_WRITE_REGS] = read_write_regs_handler,
+    [MBF_READ_FILE] = read_file_handler,
+    [MBF_WRITE_FILE] = write_file_handler,
 };
 
+/* register bank of each unit ID, NULL for the default bank */
+static reg_bank_t *unit_banks[256];
+
+/* the range read ahead for the batch being handled by the thread */
+static YAM_THREAD_LOCAL const read_ahead_t *read_ahead;
+
 /**********************
  *   MACROS
  **********************/
@@ -166,6 +164,23 @@ static int make_exception(mb_func_t func, mb_exception_t expt, char *resp_buf)
     return 2;
 }
 
+/**
+ * Copy a range from the read ahead, if it starts and ends on registers
+ * of it, as the registers would have been read alone.
+ * @return zero on success, negative if the range is not there.
+ */
+static int copy_read_ahead(mb_ref_t start, uint16_t count, char *buf)
+{
+    unsigned int off = start - read_ahead->start;
+
+    if (! count || start < read_ahead->start
+            || off + count > read_ahead->count
+            || ! read_ahead->heads[off] || ! read_ahead->heads[off + count])
+        return -1;
+    memcpy(buf, read_ahead->buf + off * REGISTER_SIZE, count * REGISTER_SIZE);
+    return 0;
+}
+
 /**
  * I image the slave devcie has a virtual memory, any portion of which
  * can be addressed through a reference address. This function is
@@ -179,81 +194,153 @@ static int make_exception(mb_func_t func, mb_exception_t expt, char *resp_buf)
  */
 static int load_ref_mem(mb_ref_t start, mb_size_t len, char *buf)
 {
-    regval_t val;
-    const reg_t *reg;
-    char *p = buf;
-    int n;
-
-    while (len) {
-        if ((n = register_read(start, 0, &reg, &val)) < 0) return n;
-        if (len < n * REGISTER_SIZE) return -1;
-
-        if (regval_encode_mb(&val, p, reg->tag, reg->size, reg_mb_scale(reg)))
-            return -REG_ERR_ADDRESS_NOT_FOUND;
-
-        p += n * REGISTER_SIZE;
-        len -= n * REGISTER_SIZE;
-        start += n;
-    }
-
-    return 0;
+    /* a count of 0 reads nothing and succeeds, whatever the start */
+    if (! len) return 0;
+    if (len % REGISTER_SIZE) return -1;
+#if YAM_REG_SHADOW
+    if (! register_shadow_read(start, len / REGISTER_SIZE, buf)) return 0;
+#endif
+    if (read_ahead && ! copy_read_ahead(start, len / REGISTER_SIZE, buf))
+        return 0;
+    return register_read_range_mb(start, len / REGISTER_SIZE, buf);
 }
 
-static int load_ref_bitmap(mb_ref_t start, mb_size_t nbits, char *buf)
+/**
+ * Pack coils or discrete inputs into the response, lowest ref in the
+ * lowest bit of the first byte. The bits of each register span are
+ * added to an accumulator in one shift, which is flushed a whole byte
+ * at a time, so a read costs a loop per register and per byte instead
+ * of one per bit.
+ */
+static int load_ref_bitmap(mb_ref_t start, mb_cnt_t nbits, char *buf)
 {
     regval_t val;
     const reg_t *reg;
     char *p = buf;
-    unsigned char bit_offset;   /* inner byte */
-    int n;
+    uint64_t acc = 0;           /* bits not stored yet, lowest first */
+    unsigned int acc_bits = 0;
+    uint32_t bits;
+    int n, take;
 
-    bit_offset = 0;
-    if (nbits) *p = 0;
+#if YAM_REG_BITS
+    if (! register_bits_read(start, nbits, buf)) return 0;
+#endif
 
     while (nbits) {
         if ((n = register_read(start, OPT_BITMAP, &reg, &val)) < 0) return n;
+        bits = val.n;
 
         while (n && nbits) {
-            *p |=  (val.n & (1 << bit_offset));
-            if (++bit_offset == 8) {
-                bit_offset = 0;
-                *++p = 0;
-                val.n >>= 8;
-            }
-            n--;
-            nbits--;
-            start++;
+            take = n < nbits ? n : nbits;
+            if (take > 32) take = 32;
+            if (take < 32) bits &= (1u << take) - 1;
+            acc |= (uint64_t)bits << acc_bits;
+            acc_bits += take;
+            bits = 0;           /* a value holds 32 bits at most */
+
+            for (; acc_bits >= 8; acc_bits -= 8, acc >>= 8)
+                *p++ = acc;
+            n -= take;
+            nbits -= take;
+            start += take;
         }
     }
+    if (acc_bits) *p = acc;
 
     return 0;
 }
 
-static int store_ref_mem(mb_ref_t start, mb_size_t len, const char *buf)
+/**
+ * Get n bits, n <= 32, starting at bit pos of a packed modbus bitmap.
+ */
+static uint32_t get_bits(const char *buf, unsigned int pos, unsigned int n)
 {
-    regval_t val;
-    const reg_t *reg;
-    const char *p = buf;
-    int n;
-
-    while (len) {
-        if (register_find(start, 0, &reg) < 0
-                || len < reg->size * REGISTER_SIZE)
-            return -REG_ERR_ADDRESS_NOT_FOUND;
-
-        if (regval_decode_mb(p, &val, reg->tag, reg->size, reg_mb_scale(reg)))
-            return -REG_ERR_ADDRESS_NOT_FOUND;
+    const unsigned char *p = (const unsigned char *)buf + pos / 8;
+    uint64_t v = 0;
+    unsigned int i;
+
+    for (i = 0; i < (pos % 8 + n + 7) / 8; ++i)
+        v |= (uint64_t)p[i] << (8 * i);
+    v >>= pos % 8;
+    return n < 32 ? v & ((1u << n) - 1) : v;
+}
 
-        if ((n = register_write(start, 0, reg, &val)) < 0) return n;
+/**
+ * Find the coil register of a ref for a write of left bits from it.
+ * @param take set to the number of bits written into the register.
+ * @return the offset of ref in the register, or negative if error.
+ */
+static int find_coil(mb_ref_t ref, unsigned int left, const reg_t **reg,
+        unsigned int *take)
+{
+    unsigned int off;
+
+    if (register_find(ref, OPT_BITMAP, reg) < 0
+            || (*reg)->size > 32 || ! ((*reg)->perm & REG_PERM_WR))
+        return -REG_ERR_ADDRESS_NOT_FOUND;
+    off = ref - (*reg)->ref;
+    *take = (*reg)->size - off < left ? (*reg)->size - off : left;
+
+    /* the other bits of a register written in part are kept */
+    if (*take < (*reg)->size && ! ((*reg)->perm & REG_PERM_RD))
+        return -REG_ERR_ADDRESS_NOT_FOUND;
+    return off;
+}
 
-        p += n * REGISTER_SIZE;
-        len -= n * REGISTER_SIZE;
-        start += n;
+/**
+ * Write coils packed as in the request. Spans of the coil registers
+ * are merged into their values, and the values are written with
+ * register_write_range() by REG_RANGE_MAX registers at a time. All the
+ * coils are looked up before the first write, so a request which
+ * addresses a coil that isn't there writes none.
+ */
+static int store_ref_bitmap(mb_ref_t start, mb_cnt_t nbits, const char *buf)
+{
+    const reg_t *regs[REG_RANGE_MAX];
+    regval_t vals[REG_RANGE_MAX];
+    const reg_t *reg;
+    mb_ref_t ref;
+    unsigned int pos, take;
+    uint32_t mask;
+    int n, off, err;
+
+#if YAM_REG_BITS
+    if (! register_bits_write(start, nbits, buf)) return 0;
+#endif
+
+    for (ref = start, pos = 0; pos < nbits; ref += take, pos += take)
+        if ((off = find_coil(ref, nbits - pos, &reg, &take)) < 0)
+            return off;
+
+    for (ref = start, pos = 0, n = 0; pos < nbits; ref += take, pos += take) {
+        if ((off = find_coil(ref, nbits - pos, &reg, &take)) < 0)
+            return off;
+        mask = (take < 32 ? (1u << take) - 1 : ~0u) << off;
+
+        if (take < reg->size) {
+            if ((err = register_read(reg->ref, 0, &reg, &vals[n])) < 0)
+                return err;
+            regval_put_integer(&vals[n], (vals[n].n & ~mask)
+                    | (get_bits(buf, pos, take) << off));
+        } else
+            regval_put_integer(&vals[n], get_bits(buf, pos, take));
+        regs[n++] = reg;
+
+        if (n == REG_RANGE_MAX || pos + take == nbits) {
+            if ((err = register_write_range(regs, vals, n)) < 0)
+                return err;
+            n = 0;
+        }
     }
-
     return 0;
 }
 
+static int store_ref_mem(mb_ref_t start, mb_size_t len, const char *buf)
+{
+    if (len % REGISTER_SIZE) return -REG_ERR_ADDRESS_NOT_FOUND;
+    return register_write_range_mb(start, len / REGISTER_SIZE, buf);
+}
+
 static int read_coils_handler(mb_func_t func,
         const char *req_buf,
         mb_size_t req_len,
@@ -278,6 +365,70 @@ static int read_coils_handler(mb_func_t func,
     return rd_resp_header_len() + mem_sz;
 }
 
+static int write_coil_handler(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz)
+{
+    int err;
+
+    if (req_len != sizeof(mb_ref_t) + REGISTER_SIZE)
+        goto illegal_req;
+
+    const unsigned char *req = (const unsigned char *)req_buf;
+    mb_ref_t ref_start = req[0] * 256 + req[1];
+    uint16_t value = req[2] * 256 + req[3];
+    char bit = value ? 1 : 0;
+
+    if (value != 0xff00 && value != 0) goto illegal_req;
+
+    chk_wr_resp_buf_size(func, buf_sz, resp_buf);
+
+    err = store_ref_bitmap(ref_start + COILS_REF_FIRST, 1, &bit);
+    catch_modbus_exception(func, err, resp_buf);
+
+    wr_resp(func, ref_start, value);
+    return wr_resp_len();
+
+illegal_req:
+    return make_exception(func, ERR_ILLEGAL_DATA_VALUE, resp_buf);
+}
+
+static int write_coils_handler(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz)
+{
+    int err;
+
+    if (req_len < sizeof(mb_ref_t) + sizeof(mb_cnt_t) + 1)
+        goto illegal_req;
+
+    const unsigned char *req = (const unsigned char *)req_buf;
+    mb_ref_t ref_start = req[0] * 256 + req[1];
+    mb_cnt_t write_cnt = req[2] * 256 + req[3];
+    mb_size_t mem_sz = req[sizeof(mb_ref_t) + sizeof(mb_cnt_t)];
+
+    if (! write_cnt || write_cnt > WRITE_COILS_MAX
+            || mem_sz != (write_cnt + COILS_PER_BYTE - 1) / COILS_PER_BYTE
+            || req_len < sizeof(mb_ref_t) + sizeof(mb_cnt_t) + 1 + mem_sz)
+        goto illegal_req;
+
+    chk_wr_resp_buf_size(func, buf_sz, resp_buf);
+
+    err = store_ref_bitmap(ref_start + COILS_REF_FIRST, write_cnt,
+            req_buf + sizeof(mb_ref_t) + sizeof(mb_cnt_t) + 1);
+    catch_modbus_exception(func, err, resp_buf);
+
+    wr_resp(func, ref_start, write_cnt);
+    return wr_resp_len();
+
+illegal_req:
+    return make_exception(func, ERR_ILLEGAL_DATA_VALUE, resp_buf);
+}
+
 static int write_regs_handler(mb_func_t func,
         const char *req_buf,
         mb_size_t req_len,
@@ -364,6 +515,52 @@ static int read_holding_regs_handler(mb_func_t func,
     return rd_resp_header_len() + mem_sz;
 }
 
+/**
+ * The write is applied before the read, so the read returns the values
+ * just written where the two ranges overlap.
+ */
+static int read_write_regs_handler(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz)
+{
+    int err;
+    const size_t header_len = 2 * (sizeof(mb_ref_t) + sizeof(mb_cnt_t)) + 1;
+
+    if (req_len < header_len) goto illegal_req;
+
+    const unsigned char *req = (const unsigned char *)req_buf;
+    mb_ref_t read_start = req[0] * 256 + req[1];
+    mb_cnt_t read_cnt = req[2] * 256 + req[3];
+    mb_ref_t write_start = req[4] * 256 + req[5];
+    mb_cnt_t write_cnt = req[6] * 256 + req[7];
+    mb_size_t write_sz = req[8];
+    mb_size_t mem_sz = read_cnt * REGISTER_SIZE;
+
+    if (! read_cnt || read_cnt > READ_WRITE_REGS_READ_MAX
+            || ! write_cnt || write_cnt > READ_WRITE_REGS_WRITE_MAX
+            || write_sz != write_cnt * REGISTER_SIZE
+            || req_len < header_len + write_sz)
+        goto illegal_req;
+
+    chk_rd_resp_buf_size(func, buf_sz, mem_sz, resp_buf);
+
+    err = store_ref_mem(write_start + HOLDING_REGS_REF_FIRST,
+            write_sz, req_buf + header_len);
+    catch_modbus_exception(func, err, resp_buf);
+
+    err = load_ref_mem(read_start + HOLDING_REGS_REF_FIRST,
+            mem_sz, resp_buf + rd_resp_header_len());
+    catch_modbus_exception(func, err, resp_buf);
+
+    rd_resp_header(func, mem_sz, resp_buf);
+    return rd_resp_header_len() + mem_sz;
+
+illegal_req:
+    return make_exception(func, ERR_ILLEGAL_DATA_VALUE, resp_buf);
+}
+
 static int read_file_handler(mb_func_t func,
         const char *req_buf,
         mb_size_t req_len,
@@ -422,17 +619,116 @@ int yam_app_input(mb_dev_addr_t slave_addr,
         char *resp_buf,
         mb_size_t buf_sz)
 {
-    size_t i;
-    mb_func_t func = req->payload[0];
-
-    for (i = 0;
-            i < sizeof(func_handlers) / sizeof(mb_func_handler_map_t)
-            && func_handlers[i].func != func;
-            ++i);
-    if (i == sizeof(func_handlers) / sizeof(mb_func_handler_map_t))
+    mb_func_t func = (unsigned char)req->payload[0];
+    mb_func_handler_t handler;
+    reg_bank_t *bank;
+    int token, n;
+
+    if (func >= FUNC_CODES
+            || ! (handler = __atomic_load_n(&func_handlers[func],
+                    __ATOMIC_ACQUIRE)))
         return -YAM_ERR_UNKNOWN_MESSAGE;
 
-    return func_handlers[i].handler(func,
+    /* registers found while handling the request stay valid even if
+     * their table is replaced meanwhile
+     */
+    token = register_read_lock();
+    bank = register_select_bank(
+            __atomic_load_n(&unit_banks[slave_addr], __ATOMIC_ACQUIRE));
+    trace_begin(TRACE_DISPATCH, func);
+    n = handler(func,
             ((char *)req->payload) + 1, req->len - 1,
             resp_buf, buf_sz);
+    trace_end(TRACE_DISPATCH, func);
+    register_select_bank(bank);
+    register_read_unlock(token);
+    return n;
+}
+
+/**
+ * Tell the range of a holding registers read request.
+ * @return zero if the request is one, negative otherwise.
+ */
+static int rd_regs_range(const mb_pbuf_t *req, mb_ref_t *start,
+        uint16_t *count)
+{
+    const unsigned char *p = (const unsigned char *)req->payload;
+
+    if (req->len != 1 + sizeof(mb_ref_t) + sizeof(mb_cnt_t)
+            || p[0] != MBF_READ_HOLDING_REGS)
+        return -1;
+    *start = HOLDING_REGS_REF_FIRST + p[1] * 256 + p[2];
+    *count = p[3] * 256 + p[4];
+    return *count && *count <= REG_RANGE_MAX ? 0 : -1;
+}
+
+int yam_app_input_batch(mb_batch_req_t *reqs, size_t n)
+{
+    read_ahead_t ra;
+    reg_bank_t *bank, *prev;
+    mb_ref_t start;
+    uint16_t count;
+    unsigned int lo = 0, hi = 0;
+    size_t i, j, k;
+    int token;
+
+    for (i = 0; i < n; i = j) {
+        j = i + 1;
+        bank = __atomic_load_n(&unit_banks[reqs[i].slave_addr],
+                __ATOMIC_ACQUIRE);
+
+        /* the following reads of the same bank which join up with the
+         * range so far are read with it, unless a register of the range
+         * is read by a callback, see register_read_range_mb_heads()
+         */
+        if (! rd_regs_range(&reqs[i].req, &start, &count)) {
+            lo = start;
+            hi = start + count;
+            for (; j < n && ! rd_regs_range(&reqs[j].req, &start, &count)
+                    && __atomic_load_n(&unit_banks[reqs[j].slave_addr],
+                        __ATOMIC_ACQUIRE) == bank
+                    && start <= hi && start + count >= lo
+                    && (start + count > hi ? start + count : hi)
+                        - (start < lo ? start : lo) <= REG_RANGE_MAX;
+                    ++j) {
+                if (start < lo) lo = start;
+                if (start + count > hi) hi = start + count;
+            }
+        }
+
+        /* the range read ahead is traced with the first request */
+        trace_begin(TRACE_REQUEST, 0);
+        if (j - i > 1) {
+            token = register_read_lock();
+            prev = register_select_bank(bank);
+            ra.start = lo;
+            ra.count = hi - lo;
+            if (! register_read_range_mb_heads(ra.start, ra.count, ra.buf,
+                        ra.heads))
+                read_ahead = &ra;
+            register_select_bank(prev);
+            register_read_unlock(token);
+        }
+
+        for (k = i; i < j; ++i) {
+            if (i > k) trace_begin(TRACE_REQUEST, 0);
+            reqs[i].resp_len = yam_app_input(reqs[i].slave_addr,
+                    &reqs[i].req, reqs[i].resp_buf, reqs[i].buf_sz);
+            trace_end(TRACE_REQUEST, 0);
+        }
+        read_ahead = NULL;
+    }
+    return n;
+}
+
+int yam_app_register_handler(mb_func_t func, mb_func_handler_t handler)
+{
+    if (! func || func >= FUNC_CODES) return -YAM_ERR_UNKNOWN_MESSAGE;
+    __atomic_store_n(&func_handlers[func], handler, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void yam_app_bind_bank(mb_dev_addr_t slave_addr, reg_bank_t *bank)
+{
+    __atomic_store_n(&unit_banks[slave_addr], bank, __ATOMIC_RELEASE);
 }
@@ -10,6 +10,7 @@
  *********************/
 #include <stdint.h>
 #include "register.h"
+#include "regindex.h"
 
 /*********************
  *      DEFINES
@@ -26,6 +27,46 @@ typedef struct {
     mb_size_t len;
 } mb_pbuf_t;
 
+typedef enum {
+    MBF_READ_COILS              = 1,
+    MBF_READ_DISCRETE_INPUTS    = 2,
+    MBF_WRITE_COIL              = 5,
+    MBF_WRITE_COILS             = 15,
+    MBF_WRITE_REG               = 6,
+    MBF_WRITE_REGS              = 16,
+    MBF_READ_HOLDING_REGS       = 3,
+    MBF_READ_FILE               = 20,
+    MBF_WRITE_FILE               = 21,
+    MBF_READ_WRITE_REGS         = 23,
+} mb_func_t;
+
+/**
+ * A request of yam_app_input_batch() and its response.
+ */
+typedef struct {
+    mb_dev_addr_t slave_addr;
+    mb_pbuf_t req;
+    char *resp_buf;             /* to hold the response PDU */
+    mb_size_t buf_sz;
+    int resp_len;
+} mb_batch_req_t;
+
+/**
+ * Handle the request PDU of a function code.
+ * @param func the function code
+ * @param req_buf the request PDU after the function code
+ * @param req_len length of req_buf
+ * @param resp_buf buffer to hold the response PDU, function code
+ *        included
+ * @param buf_sz size of the response buffer
+ * @return negative if error or the length of the response PDU.
+ */
+typedef int (* mb_func_handler_t)(mb_func_t func,
+        const char *req_buf,
+        mb_size_t req_len,
+        char *resp_buf,
+        mb_size_t buf_sz);
+
 /**********************
  * GLOBAL PROTOTYPES
  **********************/
@@ -48,6 +89,40 @@ int yam_app_input(mb_dev_addr_t slave_addr,
         char *resp_buf,
         mb_size_t buf_sz);
 
+/**
+ * Handle a batch of request PDUs as yam_app_input() does each in turn.
+ * Consecutive holding register reads (FC3) of one register bank whose
+ * ranges join up are read as one range, with one index lookup and one
+ * batched store call, when all their registers are read from the store
+ * or the shadow image. If any of them has a read_cb or is an array with
+ * a read_block, the requests are handled one by one, so the callbacks
+ * are called once per request as without the batch.
+ * @param reqs the requests, the resp_len of each is set to what
+ *        yam_app_input() returns for it.
+ * @param n number of requests.
+ * @return number of requests handled.
+ */
+int yam_app_input_batch(mb_batch_req_t *reqs, size_t n);
+
+/**
+ * Set the handler of a function code, e.g., of a vendor defined one,
+ * or replace the built-in one. It's called as the built-in handlers
+ * are, inside a register read lock and with the bank of the unit ID
+ * selected.
+ * @param func the function code, 1 to 127
+ * @param handler the handler, NULL to make the code unknown
+ * @return zero on success, or negative if the code is out of range.
+ */
+int yam_app_register_handler(mb_func_t func, mb_func_handler_t handler);
+
+/**
+ * Bind a modbus unit ID to a register bank, requests to the unit ID
+ * will be served by the registers and store callbacks of the bank.
+ * @param slave_addr the unit ID
+ * @param bank the bank, NULL to serve the unit ID by the default bank
+ */
+void yam_app_bind_bank(mb_dev_addr_t slave_addr, reg_bank_t *bank);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
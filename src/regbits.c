@@ -0,0 +1,197 @@
+/**
+ * @file regbits.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "err.h"
+#include "regbits.h"
+#include "regchange.h"
+#include "regindex.h"
+
+#if YAM_REG_BITS
+
+/*********************
+ *      DEFINES
+ *********************/
+/* one more word, so a span can always be read from two words */
+#define WORDS(nbits)    ((nbits) / 32 + 2)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    mb_ref_t first;
+    unsigned int n;
+    uint32_t *words;
+} bit_space_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static uint32_t coils[WORDS(YAM_REG_BITS_COILS)];
+static uint32_t inputs[WORDS(YAM_REG_BITS_DISCRETE_INPUTS)];
+
+static const bit_space_t spaces[] = {
+    { COILS_REF_FIRST, YAM_REG_BITS_COILS, coils },
+    { DISCRETE_INPUT_REF_FIRST, YAM_REG_BITS_DISCRETE_INPUTS, inputs },
+};
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+/**
+ * @param coils_only look up the coils only, the discrete inputs are
+ *      read-only to the master.
+ */
+static const bit_space_t *find_space(mb_ref_t start, unsigned int n,
+        int coils_only)
+{
+    unsigned int i;
+
+    for (i = 0; i < (coils_only ? 1 : sizeof(spaces) / sizeof(spaces[0]));
+            ++i)
+        if (start >= spaces[i].first
+                && start - spaces[i].first + n <= spaces[i].n)
+            return &spaces[i];
+    return NULL;
+}
+
+static inline uint32_t low_mask(unsigned int n)
+{
+    return n < 32 ? (1u << n) - 1 : ~0u;
+}
+
+/**
+ * Replace the bits of mask in a word.
+ * @return the bits which changed.
+ */
+static uint32_t update_word(uint32_t *word, uint32_t mask, uint32_t bits)
+{
+    uint32_t old = __atomic_load_n(word, __ATOMIC_RELAXED);
+
+    while (! __atomic_compare_exchange_n(word, &old,
+                (old & ~mask) | (bits & mask), 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return (old ^ bits) & mask;
+}
+
+#if YAM_REG_CHANGE_TRACKING
+static void mark_changed(mb_ref_t ref, uint32_t changed)
+{
+    while (changed) {
+        yam_reg_mark_changed(ref + __builtin_ctz(changed));
+        changed &= changed - 1;
+    }
+}
+#else
+#define mark_changed(ref, changed) (void)(changed)
+#endif
+
+static void load_bits(const bit_space_t *sp, unsigned int off,
+        unsigned int n, char *buf)
+{
+    unsigned int i, k, sh, w;
+    uint32_t v;
+
+    for (i = 0; i < n; i += 32) {
+        w = (off + i) / 32;
+        sh = (off + i) % 32;
+        v = __atomic_load_n(&sp->words[w], __ATOMIC_RELAXED) >> sh;
+        if (sh)
+            v |= __atomic_load_n(&sp->words[w + 1], __ATOMIC_RELAXED)
+                << (32 - sh);
+        v &= low_mask(n - i);
+
+        for (k = 0; k < 32 && i + k < n; k += 8)
+            *buf++ = v >> k;
+    }
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+int yam_reg_get_bit(mb_ref_t ref)
+{
+    const bit_space_t *sp = find_space(ref, 1, 0);
+    unsigned int off;
+
+    if (! sp) return -REG_ERR_ADDRESS_NOT_FOUND;
+    off = ref - sp->first;
+    return (__atomic_load_n(&sp->words[off / 32], __ATOMIC_ACQUIRE)
+            >> (off % 32)) & 1;
+}
+
+int yam_reg_set_bit(mb_ref_t ref, int on)
+{
+    const bit_space_t *sp = find_space(ref, 1, 0);
+    unsigned int off;
+    uint32_t changed;
+
+    if (! sp) return -REG_ERR_ADDRESS_NOT_FOUND;
+    off = ref - sp->first;
+
+    yam_reg_update_begin(NULL);
+    changed = update_word(&sp->words[off / 32], 1u << (off % 32),
+            on ? ~0u : 0);
+    mark_changed(sp->first + off / 32 * 32, changed);
+    yam_reg_update_end(NULL);
+    return 0;
+}
+
+int register_bits_read(mb_ref_t start, unsigned int n, char *buf)
+{
+    const bit_space_t *sp;
+#if YAM_REG_SNAPSHOT_READ
+    uint32_t seq;
+#endif
+
+    if (regbank_current() != regbank_default()
+            || ! (sp = find_space(start, n, 0)))
+        return -1;
+
+#if YAM_REG_SNAPSHOT_READ
+    do {
+        seq = regbank_read_begin(regbank_default());
+        load_bits(sp, start - sp->first, n, buf);
+    } while (regbank_read_retry(regbank_default(), seq));
+#else
+    load_bits(sp, start - sp->first, n, buf);
+#endif
+    return 0;
+}
+
+int register_bits_write(mb_ref_t start, unsigned int n, const char *buf)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    const bit_space_t *sp;
+    unsigned int off, i, k, sh, w;
+    uint32_t v, mask, changed;
+
+    if (regbank_current() != regbank_default()
+            || ! (sp = find_space(start, n, 1)))
+        return -1;
+    off = start - sp->first;
+
+    yam_reg_update_begin(NULL);
+    for (i = 0; i < n; i += 32) {
+        for (v = 0, k = 0; k < 32 && i + k < n; k += 8)
+            v |= (uint32_t)*p++ << k;
+        mask = low_mask(n - i);
+        w = (off + i) / 32;
+        sh = (off + i) % 32;
+
+        changed = update_word(&sp->words[w], mask << sh, v << sh);
+        mark_changed(sp->first + w * 32, changed);
+        if (sh && mask >> (32 - sh)) {
+            changed = update_word(&sp->words[w + 1], mask >> (32 - sh),
+                    v >> (32 - sh));
+            mark_changed(sp->first + (w + 1) * 32, changed);
+        }
+    }
+    yam_reg_update_end(NULL);
+    return 0;
+}
+
+#endif /* YAM_REG_BITS */
@@ -0,0 +1,70 @@
+/**
+ * @file regbits.h
+ * @brief Packed bit-array store of coils and discrete inputs
+ *
+ * The first YAM_REG_BITS_COILS coils and YAM_REG_BITS_DISCRETE_INPUTS
+ * discrete inputs are kept as bits in arrays of 32-bit words, instead
+ * of being declared as registers. Reads and writes from the master
+ * (FC1, FC2, FC5 and FC15) move whole words, shifted and masked across
+ * word boundaries. Requests outside the arrays fall back to the coils
+ * and discrete inputs declared as registers.
+ *
+ * Only the default bank is served by the bit store.
+ */
+
+#ifndef __YAM_REGBITS_H
+#define __YAM_REGBITS_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "../options.h"
+#include "register.h"
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if YAM_REG_BITS
+/**
+ * Get a coil or discrete input of the bit store.
+ * @param ref ref of the bit, e.g., 1 or 10001.
+ * @return 0 or 1, or negative if ref is not in the bit store.
+ */
+int yam_reg_get_bit(mb_ref_t ref);
+
+/**
+ * Set a coil or discrete input of the bit store. It's an update of the
+ * default bank like a write from the master, the change is tracked and
+ * snapshot reads never see it half done.
+ * @param ref ref of the bit.
+ * @param on the new state.
+ * @return 0 on success, or negative if ref is not in the bit store.
+ */
+int yam_reg_set_bit(mb_ref_t ref, int on);
+
+/**
+ * Pack bits of the bit store in modbus order, the bit of start in the
+ * lowest bit of the first byte, and the unused bits of the last byte
+ * cleared.
+ * @return 0 on success, or -1 if the range is not in the bit store.
+ */
+int register_bits_read(mb_ref_t start, unsigned int n, char *buf);
+
+/**
+ * Write coils packed in modbus order into the bit store, the discrete
+ * inputs are read-only to the master.
+ * @return 0 on success, or -1 if the range is not in the coils of the
+ *      bit store.
+ */
+int register_bits_write(mb_ref_t start, unsigned int n, const char *buf);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGBITS_H */
@@ -0,0 +1,336 @@
+/**
+ * @file regcache.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "regcache.h"
+#include "regindex.h"
+
+#if YAM_REG_CACHE
+
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+/*********************
+ *      DEFINES
+ *********************/
+#define GROUPS_MAX          16
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    const char *group;
+    unsigned int max_age;
+    unsigned int refresh;
+} group_policy_t;
+
+/**
+ * A slot stays with its register until it's taken by another one, the
+ * ref is kept to check the register still exists before the refresh
+ * thread touches it.
+ */
+typedef struct {
+    const reg_t *reg;       /* NULL if free */
+    mb_ref_t ref;
+    int valid;
+    uint32_t gen;           /* bumped when the value is dropped */
+    regval_t val;
+    uint64_t stamp;         /* when val was read */
+    uint64_t used;          /* the latest read of val */
+    unsigned int max_age;
+    unsigned int refresh;
+} slot_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake;
+static pthread_t thread;
+static int running;
+static unsigned int tick;
+
+static group_policy_t groups[GROUPS_MAX];
+static int groups_num;
+static group_policy_t default_policy;
+static int caching;             /* nonzero if a policy has a max age */
+
+static slot_t slots[YAM_REG_CACHE_SLOTS];
+
+/* owner of the slots whose register is gone, they can be taken again */
+static const reg_t gone;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static uint64_t now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static const group_policy_t *policy_of(const reg_t *reg)
+{
+    int i;
+
+    if (reg->group)
+        for (i = 0; i < groups_num; ++i)
+            if (! strcmp(groups[i].group, reg->group))
+                return &groups[i];
+    return &default_policy;
+}
+
+/**
+ * Rank of a slot to be taken by another register, the lowest first: a
+ * free slot, then one without a value, then the least recently read.
+ */
+static inline uint64_t victim_rank(const slot_t *s)
+{
+    if (! s->reg || s->reg == &gone) return 0;
+    return s->valid ? s->used + 2 : 1;
+}
+
+/**
+ * Find the slot of a register, or take one if create is set. When no
+ * slot is free, the one of the register read the least recently is
+ * taken, a slot is only reassigned in place so the probe sequences of
+ * the other registers stay whole. Called with the lock held.
+ */
+static slot_t *find_slot(const reg_t *reg, int create)
+{
+    slot_t *s, *victim = NULL;
+    unsigned int i, k;
+
+    for (i = 0, k = reg->ref % YAM_REG_CACHE_SLOTS;
+            i < YAM_REG_CACHE_SLOTS;
+            ++i, k = (k + 1) % YAM_REG_CACHE_SLOTS) {
+        s = &slots[k];
+        if (s->reg == reg) return s;
+        if (! victim || victim_rank(s) < victim_rank(victim)) victim = s;
+        if (! s->reg) break;
+    }
+    if (! create) return NULL;
+
+    victim->reg = reg;
+    victim->ref = reg->ref;
+    victim->valid = 0;
+    victim->gen++;
+    return victim;
+}
+
+/**
+ * Read again the values due for a refresh. Called with the lock held,
+ * it's released while a read_cb runs.
+ */
+static void refresh_due(void)
+{
+    const reg_t *reg, *found;
+    regval_t val;
+    slot_t *s;
+    uint64_t now;
+    uint32_t gen;
+    mb_ref_t ref;
+    int i, token, err;
+
+    for (i = 0; i < YAM_REG_CACHE_SLOTS; ++i) {
+        s = &slots[i];
+        if (! s->reg || s->reg == &gone || ! s->valid) continue;
+
+        now = now_ms();
+        if (now - s->used >= (uint64_t)s->max_age * YAM_REG_CACHE_IDLE_AGES) {
+            s->valid = 0;
+            continue;
+        }
+        if (now - s->stamp < s->refresh) continue;
+
+        reg = s->reg;
+        ref = s->ref;
+        gen = s->gen;
+        pthread_mutex_unlock(&lock);
+
+        /* the register is only touched if its table is still there */
+        token = register_read_lock();
+        if (register_find(ref, 0, &found) < 0 || found != reg) {
+            err = -1;
+            found = NULL;
+        } else {
+            val.tag = reg->tag;
+            err = reg->read_cb(reg, &val);
+        }
+        register_read_unlock(token);
+
+        pthread_mutex_lock(&lock);
+        if (s->reg != reg) continue;
+        if (! found) s->reg = &gone;
+        else if (err >= 0 && s->gen == gen) {
+            s->val = val;
+            s->stamp = now_ms();
+        }
+    }
+}
+
+static void *refresher(void *arg)
+{
+    struct timespec ts;
+
+    (void)arg;
+    pthread_mutex_lock(&lock);
+    while (running) {
+        refresh_due();
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_sec += tick / 1000;
+        ts.tv_nsec += (tick % 1000) * 1000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000;
+        }
+        if (running) pthread_cond_timedwait(&wake, &lock, &ts);
+    }
+    pthread_mutex_unlock(&lock);
+    return NULL;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+int yam_reg_cache_set_policy(const char *group, unsigned int max_age_ms,
+        unsigned int refresh_ms)
+{
+    group_policy_t *p = &default_policy;
+    int i;
+
+    pthread_mutex_lock(&lock);
+    if (group) {
+        for (i = 0; i < groups_num && strcmp(groups[i].group, group); ++i);
+        if (i == GROUPS_MAX) {
+            pthread_mutex_unlock(&lock);
+            return -1;
+        }
+        if (i == groups_num) ++groups_num;
+        p = &groups[i];
+        p->group = group;
+    }
+    p->max_age = max_age_ms;
+    p->refresh = refresh_ms;
+
+    for (i = 0; i < groups_num && ! groups[i].max_age; ++i);
+    __atomic_store_n(&caching, default_policy.max_age || i < groups_num,
+            __ATOMIC_RELEASE);
+
+    /* writes don't drop values while nothing is cached, none is kept */
+    if (! caching)
+        for (i = 0; i < YAM_REG_CACHE_SLOTS; ++i) {
+            slots[i].valid = 0;
+            slots[i].gen++;
+        }
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
+int yam_reg_cache_start(unsigned int tick_ms)
+{
+    pthread_condattr_t attr;
+
+    if (running) return -1;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    tick = tick_ms ? tick_ms : 1;
+    running = 1;
+    if (pthread_create(&thread, NULL, refresher, NULL)) {
+        running = 0;
+        pthread_cond_destroy(&wake);
+        return -1;
+    }
+    return 0;
+}
+
+void yam_reg_cache_stop(void)
+{
+    if (! running) return;
+
+    pthread_mutex_lock(&lock);
+    running = 0;
+    pthread_cond_signal(&wake);
+    pthread_mutex_unlock(&lock);
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&wake);
+
+    pthread_mutex_lock(&lock);
+    memset(slots, 0, sizeof(slots));
+    pthread_mutex_unlock(&lock);
+}
+
+int register_cache_load(const reg_t *reg, regval_t *val)
+{
+    slot_t *s;
+    uint64_t now;
+    int err = -1;
+
+    /* nothing is cached without a policy, the lock isn't needed */
+    if (! __atomic_load_n(&caching, __ATOMIC_ACQUIRE)
+            || regbank_current() != regbank_default())
+        return -1;
+
+    pthread_mutex_lock(&lock);
+    if ((s = find_slot(reg, 0)) && s->valid) {
+        now = now_ms();
+        if (now - s->stamp < s->max_age) {
+            *val = s->val;
+            s->used = now;
+            err = 0;
+        }
+    }
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+void register_cache_fill(const reg_t *reg, const regval_t *val)
+{
+    const group_policy_t *p;
+    slot_t *s;
+
+    if (! __atomic_load_n(&caching, __ATOMIC_ACQUIRE)
+            || regbank_current() != regbank_default())
+        return;
+
+    pthread_mutex_lock(&lock);
+    p = policy_of(reg);
+    if (p->max_age && (s = find_slot(reg, 1))) {
+        s->val = *val;
+        s->stamp = s->used = now_ms();
+        s->max_age = p->max_age;
+        s->refresh = p->refresh;
+        s->valid = 1;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+void register_cache_drop(const reg_t *reg)
+{
+    slot_t *s;
+
+    /* as for a load, writes don't take the lock while nothing is cached */
+    if (! __atomic_load_n(&caching, __ATOMIC_ACQUIRE)
+            || regbank_current() != regbank_default())
+        return;
+
+    pthread_mutex_lock(&lock);
+    if ((s = find_slot(reg, 0))) {
+        s->valid = 0;
+        s->gen++;
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+#endif /* YAM_REG_CACHE */
@@ -0,0 +1,85 @@
+/**
+ * @file regcache.h
+ * @brief Value cache of registers read through a read_cb
+ *
+ * A read_cb which talks to a slow sensor puts its latency on every
+ * modbus response. With a cache policy for the register group
+ * (reg_t.group), the value returned by the read_cb is kept for a max
+ * age, and a refresh thread calls the read_cb again once the value is
+ * older than the refresh period, ahead of its expiry. So reads inside
+ * the max age return at once, and a read only waits for the read_cb
+ * when the value has expired. A register which is not read for
+ * YAM_REG_CACHE_IDLE_AGES max ages is no longer refreshed. When the
+ * YAM_REG_CACHE_SLOTS slots are all taken, a new register takes the
+ * slot of the one read the least recently.
+ *
+ * A write of a cached register drops its value. Only the registers of
+ * the default bank are cached.
+ *
+ * Note: this needs a POSIX system with pthreads, and read_cb's of the
+ * cached registers have to be safe to call from the refresh thread.
+ */
+
+#ifndef __YAM_REGCACHE_H
+#define __YAM_REGCACHE_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "../options.h"
+#include "register.h"
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if YAM_REG_CACHE
+/**
+ * Set the cache policy of a register group.
+ * @param group name of the group, NULL to set the default policy of
+ *      registers which are not in a configured group.
+ * @param max_age_ms how long a value is used, zero not to cache.
+ * @param refresh_ms age at which the refresh thread reads a value
+ *      again, it should be less than max_age_ms.
+ * @return 0 on success, or negative if too many groups are configured.
+ */
+int yam_reg_cache_set_policy(const char *group, unsigned int max_age_ms,
+        unsigned int refresh_ms);
+
+/**
+ * Start the refresh thread.
+ * @param tick_ms how often it checks for values to refresh.
+ * @return 0 on success, or negative if error.
+ */
+int yam_reg_cache_start(unsigned int tick_ms);
+
+/**
+ * Stop the refresh thread and drop all the cached values.
+ */
+void yam_reg_cache_stop(void);
+
+/**
+ * Get the cached value of a register, called by the register layer.
+ * @return 0 if it was cached and fresh, or -1 otherwise.
+ */
+int register_cache_load(const reg_t *reg, regval_t *val);
+
+/**
+ * Cache a value just returned by the read_cb of a register.
+ */
+void register_cache_fill(const reg_t *reg, const regval_t *val);
+
+/**
+ * Drop the cached value of a register.
+ */
+void register_cache_drop(const reg_t *reg);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGCACHE_H */
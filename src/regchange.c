@@ -0,0 +1,119 @@
+/**
+ * @file regchange.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdlib.h>
+#include "regchange.h"
+
+#if YAM_REG_CHANGE_TRACKING
+
+/*********************
+ *      DEFINES
+ *********************/
+#define PAGE_REFS       256
+#define BLOCK_REFS      32
+#define PAGE_BLOCKS     (PAGE_REFS / BLOCK_REFS)
+#define PAGES           (65536 / PAGE_REFS)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+/**
+ * Pages are allocated on the first change of a ref in them. The page
+ * and block epochs are the latest epoch of any change inside, so a
+ * scan skips the untouched pages and blocks.
+ */
+typedef struct {
+    uint32_t epoch;
+    uint32_t block_epoch[PAGE_BLOCKS];
+    uint32_t dirty[PAGE_BLOCKS];    /* refs ever changed */
+    uint32_t ref_epoch[PAGE_REFS];
+} change_page_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static change_page_t *pages[PAGES];
+static uint32_t cur_epoch;
+static char lock;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+/**
+ * Changes are recorded under a spin lock, so once the scanner has
+ * taken a snapshot of the epoch, all the changes up to it are visible.
+ */
+static inline void change_lock(void)
+{
+    while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE));
+}
+
+static inline void change_unlock(void)
+{
+    __atomic_clear(&lock, __ATOMIC_RELEASE);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+void yam_reg_mark_changed(mb_ref_t ref)
+{
+    change_page_t *page;
+    unsigned int i = ref % PAGE_REFS;
+    unsigned int b = i / BLOCK_REFS;
+    uint32_t epoch;
+
+    change_lock();
+    if (! (page = pages[ref / PAGE_REFS])) {
+        if (! (page = calloc(1, sizeof(change_page_t)))) {
+            change_unlock();
+            return;
+        }
+        __atomic_store_n(&pages[ref / PAGE_REFS], page, __ATOMIC_RELEASE);
+    }
+
+    epoch = ++cur_epoch;
+    page->ref_epoch[i] = epoch;
+    page->dirty[b] |= 1u << (i % BLOCK_REFS);
+    page->block_epoch[b] = epoch;
+    page->epoch = epoch;
+    change_unlock();
+}
+
+uint32_t yam_reg_changes_since(uint32_t epoch, reg_change_cb_t cb)
+{
+    change_page_t *page;
+    uint32_t snapshot, bits, e;
+    unsigned int p, b, k;
+
+    change_lock();
+    snapshot = cur_epoch;
+    change_unlock();
+
+    for (p = 0; p < PAGES; ++p) {
+        page = __atomic_load_n(&pages[p], __ATOMIC_ACQUIRE);
+        if (! page || __atomic_load_n(&page->epoch, __ATOMIC_RELAXED) <= epoch)
+            continue;
+
+        for (b = 0; b < PAGE_BLOCKS; ++b) {
+            if (__atomic_load_n(&page->block_epoch[b], __ATOMIC_RELAXED) <= epoch)
+                continue;
+
+            bits = __atomic_load_n(&page->dirty[b], __ATOMIC_RELAXED);
+            while (bits) {
+                k = b * BLOCK_REFS + __builtin_ctz(bits);
+                bits &= bits - 1;
+                e = __atomic_load_n(&page->ref_epoch[k], __ATOMIC_RELAXED);
+                if (e > epoch) cb(p * PAGE_REFS + k, e);
+            }
+        }
+    }
+
+    return snapshot;
+}
+
+#endif /* YAM_REG_CHANGE_TRACKING */
@@ -0,0 +1,66 @@
+/**
+ * @file regchange.h
+ * @brief Register change tracking
+ *
+ * Every change of a register is stamped with a new epoch in a two-level
+ * dirty bitmap over the ref space, so yam_reg_changes_since() only
+ * visits the registers changed after a given epoch, and a mirror of the
+ * register image can be kept up to date with a cost proportional to
+ * the changes rather than to the size of the map.
+ *
+ * Only the registers of the default bank are tracked.
+ */
+
+#ifndef __YAM_REGCHANGE_H
+#define __YAM_REGCHANGE_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include "../options.h"
+#include "register.h"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+/**
+ * Called for each changed register.
+ * @param ref ref of the register.
+ * @param epoch epoch of its latest change.
+ */
+typedef void (* reg_change_cb_t)(mb_ref_t ref, uint32_t epoch);
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if YAM_REG_CHANGE_TRACKING
+/**
+ * Record a change of a register. Writes from the master are recorded
+ * by the register layer, the application calls it when it updates a
+ * register in the store by itself.
+ * @param ref ref of the register.
+ */
+void yam_reg_mark_changed(mb_ref_t ref);
+
+/**
+ * Visit the registers changed after an epoch.
+ * @param epoch zero for all the registers ever changed, or the value
+ *      returned by the previous call.
+ * @param cb called once for each changed register, in the order of refs.
+ * @return the epoch to pass to the next call. A change is reported by
+ *         at least one call, a change racing with a call can be
+ *         reported by the next call again.
+ */
+uint32_t yam_reg_changes_since(uint32_t epoch, reg_change_cb_t cb);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGCHANGE_H */
@@ -0,0 +1,416 @@
+/**
+ * @file regindex.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <assert.h>
+#include <stdlib.h>
+#include "err.h"
+#include "regindex.h"
+
+#ifdef __unix__
+#include <sched.h>
+#define cpu_yield() sched_yield()
+#else
+#define cpu_yield()
+#endif
+
+extern uint32_t __register_start;
+extern uint32_t __register_end;
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    const reg_t *reg;
+    int table;
+} build_entry_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static const reg_t *reg_start = (const reg_t *) &__register_start;
+static const reg_t *reg_end = (const reg_t *) &__register_end;
+
+/* table 0 of the default bank is the .register section */
+static reg_bank_t default_bank;
+static YAM_THREAD_LOCAL reg_bank_t *cur_bank;
+
+static const reg_index_t empty_index;
+
+/* readers in each of the two phases, see synchronize() */
+static unsigned int readers[2];
+static unsigned int reader_phase;
+
+static char writer_lock;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static inline void lock_writer(void)
+{
+    while (__atomic_test_and_set(&writer_lock, __ATOMIC_ACQUIRE));
+}
+
+static inline void unlock_writer(void)
+{
+    __atomic_clear(&writer_lock, __ATOMIC_RELEASE);
+}
+
+/**
+ * Wait until all the readers which might have seen the index before
+ * the latest swap are gone. New readers enter the other phase, so the
+ * wait always ends.
+ *
+ * Note: must not be called inside a read-side critical section.
+ */
+static void synchronize(void)
+{
+    unsigned int phase = __atomic_load_n(&reader_phase, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&reader_phase, phase ^ 1, __ATOMIC_SEQ_CST);
+    while (__atomic_load_n(&readers[phase], __ATOMIC_SEQ_CST))
+        cpu_yield();
+}
+
+static int build_entry_cmp(const void *a, const void *b)
+{
+    const build_entry_t *x = a;
+    const build_entry_t *y = b;
+
+    if (x->reg->ref != y->reg->ref) return x->reg->ref < y->reg->ref ? -1 : 1;
+    if (x->table != y->table) return x->table - y->table;
+    return x->reg < y->reg ? -1 : x->reg > y->reg;
+}
+
+/**
+ * Merge all the tables of a bank into a new index. Registers of a
+ * table must not overlap the ones of another table, nor share a ref
+ * with another one of the same table, so a lookup finds one register.
+ * @param out set to the new index.
+ * @return 0 on success, -REG_ERR_DATA_VALUE if registers collide, or
+ *      -REG_ERR_INTERNAL if out of memory.
+ */
+static int build_index(const reg_bank_t *bank, reg_index_t **out)
+{
+    const reg_table_t *tables = bank->tables;
+    build_entry_t *entries;
+    reg_index_t *idx;
+    reg_hot_t *hot;
+    const reg_t *reg;
+    size_t n = 0, i, k;
+    unsigned int end = 0;
+    int t, end_table = 0, err = -REG_ERR_INTERNAL;
+
+    for (t = 0; t < YAM_REG_TABLES_MAX; ++t)
+        n += tables[t].n;
+
+    entries = malloc(n * sizeof(build_entry_t) + 1);
+    /* the hot array follows the regs in the same block */
+    idx = malloc(sizeof(reg_index_t) + n * sizeof(const reg_t *)
+            + n * sizeof(reg_hot_t));
+    if (! entries || ! idx) goto fail;
+    hot = (reg_hot_t *)&idx->regs[n];
+
+    for (t = 0, k = 0; t < YAM_REG_TABLES_MAX; ++t)
+        for (i = 0; i < tables[t].n; ++i, ++k) {
+            entries[k].reg = &tables[t].regs[i];
+            entries[k].table = t;
+        }
+    qsort(entries, n, sizeof(build_entry_t), build_entry_cmp);
+
+    err = -REG_ERR_DATA_VALUE;
+    for (i = 0; i < n; ++i) {
+        reg = entries[i].reg;
+        if (reg->ref < end && entries[i].table != end_table)
+            goto fail;
+        if (i && reg->ref == entries[i - 1].reg->ref)
+            goto fail;
+        if (reg->ref + reg_span(reg) > end) {
+            end = reg->ref + reg_span(reg);
+            end_table = entries[i].table;
+        }
+        idx->regs[i] = reg;
+        hot[i].ref = reg->ref;
+        hot[i].size = reg->size;
+        hot[i].tag = reg->tag;
+        hot[i].mb_scale = reg_mb_scale(reg);
+        hot[i].perm = reg->perm & REG_PERM_MASK;
+        hot[i].codec = regval_codec_id(reg->tag, reg->size);
+        hot[i].order = reg->byte_order ? reg->byte_order : bank->byte_order;
+#if YAM_REG_ARRAY
+        hot[i].count = reg_count(reg);
+#else
+        hot[i].count = 0;
+#endif
+    }
+    idx->n = n;
+    idx->hot = hot;
+
+    free(entries);
+    *out = idx;
+    return 0;
+
+fail:
+    free(entries);
+    free(idx);
+    return err;
+}
+
+/**
+ * Called with the writer lock held.
+ */
+static void init_tables(void)
+{
+    if (default_bank.tables_used[0]) return;
+    default_bank.tables[0].regs = reg_start;
+    default_bank.tables[0].n = reg_end - reg_start;
+    default_bank.tables_used[0] = 1;
+}
+
+/**
+ * Set the registers of a table and publish a new index for it.
+ * Called with the writer lock held.
+ */
+static int update_table(reg_bank_t *bank, int id, const reg_t *regs, size_t n)
+{
+    reg_table_t old = bank->tables[id];
+    reg_index_t *idx, *old_idx;
+    int err;
+
+    bank->tables[id].regs = regs;
+    bank->tables[id].n = n;
+    if ((err = build_index(bank, &idx)) < 0) {
+        bank->tables[id] = old;
+        return err;
+    }
+
+    old_idx = bank->index;
+    __atomic_store_n(&bank->index, idx, __ATOMIC_SEQ_CST);
+    if (old_idx) {
+        synchronize();
+        free(old_idx);
+    }
+    return 0;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+int register_read_lock(void)
+{
+    unsigned int phase;
+
+    for (;;) {
+        phase = __atomic_load_n(&reader_phase, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&readers[phase], 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&reader_phase, __ATOMIC_SEQ_CST) == phase)
+            return phase;
+        /* a writer flipped the phase meanwhile, it might not wait for us */
+        __atomic_sub_fetch(&readers[phase], 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+void register_read_unlock(int token)
+{
+    __atomic_sub_fetch(&readers[token], 1, __ATOMIC_SEQ_CST);
+}
+
+reg_bank_t *register_create_bank(const regstore_cb_t *store_cb)
+{
+    reg_bank_t *bank = calloc(1, sizeof(reg_bank_t));
+
+    if (bank && store_cb) bank->store_cb = *store_cb;
+    return bank;
+}
+
+int register_destroy_bank(reg_bank_t *bank)
+{
+    reg_index_t *idx;
+
+    if (! bank || bank == &default_bank) return -REG_ERR_INTERNAL;
+
+    lock_writer();
+    idx = bank->index;
+    __atomic_store_n(&bank->index, NULL, __ATOMIC_SEQ_CST);
+    /* readers which found the bank through a unit ID are gone */
+    synchronize();
+    unlock_writer();
+
+    free(idx);
+    free(bank);
+    return 0;
+}
+
+reg_bank_t *register_select_bank(reg_bank_t *bank)
+{
+    reg_bank_t *prev = regbank_current();
+
+    cur_bank = bank;
+    return prev;
+}
+
+int register_add_table(reg_bank_t *bank, const reg_t *regs, size_t n)
+{
+    int id, err;
+
+    if (! bank) bank = &default_bank;
+
+    lock_writer();
+    init_tables();
+    for (id = 1; id < YAM_REG_TABLES_MAX && bank->tables_used[id]; ++id);
+    if (id == YAM_REG_TABLES_MAX) {
+        unlock_writer();
+        return -REG_ERR_INTERNAL;
+    }
+
+    if (! (err = update_table(bank, id, regs, n))) bank->tables_used[id] = 1;
+    unlock_writer();
+    return err < 0 ? err : id;
+}
+
+int register_replace_table(reg_bank_t *bank, int id,
+        const reg_t *regs, size_t n)
+{
+    int err;
+
+    if (id <= 0 || id >= YAM_REG_TABLES_MAX) return -REG_ERR_INTERNAL;
+    if (! bank) bank = &default_bank;
+
+    lock_writer();
+    init_tables();
+    err = bank->tables_used[id]
+        ? update_table(bank, id, regs, n) : -REG_ERR_INTERNAL;
+    unlock_writer();
+    return err;
+}
+
+int register_remove_table(reg_bank_t *bank, int id)
+{
+    int err;
+
+    if (id <= 0 || id >= YAM_REG_TABLES_MAX) return -REG_ERR_INTERNAL;
+    if (! bank) bank = &default_bank;
+
+    lock_writer();
+    init_tables();
+    if (! bank->tables_used[id]) err = -REG_ERR_INTERNAL;
+    else if (! (err = update_table(bank, id, NULL, 0)))
+        bank->tables_used[id] = 0;
+    unlock_writer();
+    return err;
+}
+
+int register_set_byte_order(reg_bank_t *bank, int order)
+{
+    uint8_t old;
+    int err;
+
+    if (order < 0 || order >= REGVAL_ORDER_NUM) return -REG_ERR_INTERNAL;
+    if (! bank) bank = &default_bank;
+
+    lock_writer();
+    init_tables();
+    old = bank->byte_order;
+    bank->byte_order = order;
+    err = update_table(bank, 0, bank->tables[0].regs, bank->tables[0].n);
+    if (err < 0) bank->byte_order = old;
+    unlock_writer();
+    return err;
+}
+
+#if YAM_REG_SNAPSHOT_READ
+void yam_reg_update_begin(reg_bank_t *bank)
+{
+    uint32_t seq;
+
+    if (! bank) bank = &default_bank;
+
+    /* an odd sequence tells an update is in progress */
+    seq = __atomic_load_n(&bank->seq, __ATOMIC_RELAXED);
+    do {
+        while (seq & 1) {
+            cpu_yield();
+            seq = __atomic_load_n(&bank->seq, __ATOMIC_RELAXED);
+        }
+    } while (! __atomic_compare_exchange_n(&bank->seq, &seq, seq + 1, 0,
+                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void yam_reg_update_end(reg_bank_t *bank)
+{
+    uint32_t seq;
+
+    if (! bank) bank = &default_bank;
+    /* writers spinning in yam_reg_update_begin() read it meanwhile */
+    seq = __atomic_load_n(&bank->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&bank->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t regbank_read_begin(const reg_bank_t *bank)
+{
+    uint32_t seq;
+
+    while ((seq = __atomic_load_n(&bank->seq, __ATOMIC_ACQUIRE)) & 1)
+        cpu_yield();
+    return seq;
+}
+
+int regbank_read_retry(const reg_bank_t *bank, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&bank->seq, __ATOMIC_RELAXED) != seq;
+}
+#endif
+
+reg_bank_t *regbank_current(void)
+{
+    return cur_bank ? cur_bank : &default_bank;
+}
+
+reg_bank_t *regbank_default(void)
+{
+    return &default_bank;
+}
+
+const reg_index_t *regindex_get(void)
+{
+    reg_bank_t *bank = regbank_current();
+    const reg_index_t *idx = __atomic_load_n(&bank->index, __ATOMIC_ACQUIRE);
+    int err;
+
+    if (idx || bank != &default_bank) return idx ? idx : &empty_index;
+
+    /* the first use, build the index of the .register section */
+    lock_writer();
+    init_tables();
+    if (! bank->index) {
+        err = update_table(bank, 0, bank->tables[0].regs, bank->tables[0].n);
+        /* registers of the section which collide are a bug of the map */
+        assert(err != -REG_ERR_DATA_VALUE);
+    }
+    idx = bank->index;
+    unlock_writer();
+
+    return idx ? idx : &empty_index;
+}
+
+int regindex_lookup(const reg_index_t *idx, mb_ref_t ref)
+{
+    size_t lo = 0, hi = idx->n, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (idx->hot[mid].ref <= ref) lo = mid + 1;
+        else hi = mid;
+    }
+    return (int)lo - 1;
+}
+
+int regindex_static(const reg_t *reg)
+{
+    return reg >= reg_start && reg < reg_end;
+}
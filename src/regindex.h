@@ -0,0 +1,250 @@
+/**
+ * @file regindex.h
+ * @brief Register banks, lookup index and runtime register tables
+ *
+ * A register bank is a set of registers with its own store callbacks,
+ * each modbus unit ID can be bound to a bank so one link serves many
+ * devices. The default bank serves the unbound unit IDs.
+ *
+ * Registers of a bank come from tables: table 0 of the default bank is
+ * the .register section, the others are added at runtime. All the
+ * tables are merged into one index sorted by ref. When a table is
+ * added, replaced or removed, a new index is built and published with
+ * a single pointer swap, the old one is freed after all the readers
+ * that might still see it are gone (a simple RCU). Readers never take
+ * a lock and always see a complete index.
+ *
+ * With YAM_REG_SNAPSHOT_READ, each bank also has a seqlock: writers of
+ * values kept in memory bracket the copy with yam_reg_update_begin()
+ * and yam_reg_update_end(), and readers copy them again until no update
+ * happened meanwhile. So the values in memory of a response reflect one
+ * point in time, including all the words of multi-register values, and
+ * readers never block writers. The store, the callbacks and any I/O are
+ * called outside the writer section, and only once per read.
+ *
+ * The shadow image (YAM_REG_SHADOW), the read_cb cache (YAM_REG_CACHE),
+ * change tracking (YAM_REG_CHANGE_TRACKING) and the bit store
+ * (YAM_REG_BITS) only serve the default bank, the registers of the
+ * other banks are always read and written through their callbacks.
+ *
+ * Note: tables are not to be added, replaced or removed inside a
+ * read-side critical section, e.g., from a read_cb or a write_cb, it
+ * would wait for itself forever.
+ */
+
+#ifndef __YAM_REGINDEX_H
+#define __YAM_REGINDEX_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stddef.h>
+#include "register.h"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+/**
+ * Hot fields of a register, copied from its reg_t when an index is
+ * built. Lookups and range checks scan these dense entries, the reg_t
+ * with the cold metadata (bounds, callbacks, strings) is only touched
+ * once a register is found.
+ */
+typedef struct {
+    mb_ref_t ref;
+    mb_size_t size;
+    type_tag_t tag;
+    int8_t mb_scale;        /* as returned by reg_mb_scale() */
+    uint8_t perm;
+    int8_t codec;           /* as returned by regval_codec_id() */
+    uint8_t order;          /* REGVAL_ORDER_* of the register or its bank */
+    uint16_t count;         /* elements of an array register, else 0 */
+} reg_hot_t;
+
+typedef struct {
+    size_t n;
+    const reg_hot_t *hot;   /* hot[i] holds the hot fields of regs[i] */
+    const reg_t *regs[];    /* sorted by ref */
+} reg_index_t;
+
+typedef struct {
+    const reg_t *regs;
+    size_t n;
+} reg_table_t;
+
+/**
+ * Members are private to the register layer.
+ */
+typedef struct reg_bank {
+    reg_index_t *index;
+#if YAM_REG_SNAPSHOT_READ
+    uint32_t seq;
+#endif
+    regstore_cb_t store_cb;
+    uint8_t byte_order;     /* REGVAL_ORDER_* of registers without one */
+    reg_table_t tables[YAM_REG_TABLES_MAX];
+    int tables_used[YAM_REG_TABLES_MAX];
+} reg_bank_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Enter a read-side critical section. Registers found inside it stay
+ * valid until the matching register_read_unlock(), even if their table
+ * is replaced meanwhile. yam_app_input() holds one for each request,
+ * others should do it when runtime tables are in use.
+ * @return a token to pass to register_read_unlock().
+ */
+int register_read_lock(void);
+
+/**
+ * Leave a read-side critical section.
+ * @param token the value returned by register_read_lock().
+ */
+void register_read_unlock(int token);
+
+/**
+ * Create a new register bank, it has no registers until tables are
+ * added to it.
+ * @param store_cb store callbacks of the bank, NULL if all its
+ *      registers have their own callbacks.
+ * @return the bank, or NULL if out of memory.
+ */
+reg_bank_t *register_create_bank(const regstore_cb_t *store_cb);
+
+/**
+ * Destroy a bank created by register_create_bank(). It must not be
+ * bound to a unit ID any more, see yam_app_bind_bank(), nor selected
+ * in any thread. When it returns, no reader sees the bank any more.
+ * @param bank the bank, the default bank can't be destroyed.
+ * @return zero on success, or negative if error.
+ */
+int register_destroy_bank(reg_bank_t *bank);
+
+/**
+ * Select the bank the register layer works on in the calling thread.
+ * @param bank the bank, NULL for the default bank.
+ * @return the previously selected bank.
+ */
+reg_bank_t *register_select_bank(reg_bank_t *bank);
+
+/**
+ * Add a runtime register table.
+ * @param bank the bank to add the table to, NULL for the default bank.
+ * @param regs the registers, not necessarily sorted. The array must
+ *      stay valid until the table is replaced or removed.
+ * @param n number of registers.
+ * @return id of the table, or negative if error: -REG_ERR_DATA_VALUE if
+ *         any register overlaps the refs of another table, or two
+ *         registers of the table have the same ref, -REG_ERR_INTERNAL if
+ *         there is no free table slot.
+ */
+int register_add_table(reg_bank_t *bank, const reg_t *regs, size_t n);
+
+/**
+ * Replace the registers of a runtime table. When it returns, no reader
+ * sees the old registers any more and they can be freed.
+ * @param bank the bank of the table, NULL for the default bank.
+ * @param id id of the table.
+ * @param regs the new registers.
+ * @param n number of registers.
+ * @return zero on success, or negative if error, the old registers
+ *         are kept in this case.
+ */
+int register_replace_table(reg_bank_t *bank, int id,
+        const reg_t *regs, size_t n);
+
+/**
+ * Remove a runtime table. When it returns, no reader sees its
+ * registers any more.
+ * @param bank the bank of the table, NULL for the default bank.
+ * @param id id of the table.
+ * @return zero on success, or negative if error.
+ */
+int register_remove_table(reg_bank_t *bank, int id);
+
+/**
+ * Set the octet order of the two-register values of a bank, registers
+ * with their own byte_order keep it. The index is rebuilt, so banks
+ * of different orders are served side by side without a global switch.
+ * @param bank the bank, NULL for the default bank.
+ * @param order one of REGVAL_ORDER_*.
+ * @return zero on success, or negative if error.
+ */
+int register_set_byte_order(reg_bank_t *bank, int order);
+
+#if YAM_REG_SNAPSHOT_READ
+/**
+ * Begin an update of register values of a bank, e.g., when the
+ * application writes its store. Updates of a bank are serialized, the
+ * section is to cover the copy of the values only, never any I/O.
+ * The register layer brackets its own copies after a write, a store
+ * keeping its values in memory brackets them from its save callbacks.
+ * @param bank the bank, NULL for the default bank.
+ *
+ * Note: not to be nested, nor called from a read_cb or a write_cb.
+ */
+void yam_reg_update_begin(reg_bank_t *bank);
+
+/**
+ * End an update of register values of a bank.
+ * @param bank the bank, NULL for the default bank.
+ */
+void yam_reg_update_end(reg_bank_t *bank);
+
+/**
+ * Begin a consistent read of a bank, it waits for an update in
+ * progress to end.
+ * @return the sequence to pass to regbank_read_retry().
+ */
+uint32_t regbank_read_begin(const reg_bank_t *bank);
+
+/**
+ * Tell if a read has to be retried since the bank was updated
+ * after regbank_read_begin().
+ */
+int regbank_read_retry(const reg_bank_t *bank, uint32_t seq);
+#else
+#define yam_reg_update_begin(bank)
+#define yam_reg_update_end(bank)
+#endif
+
+/**
+ * Get the bank selected in the calling thread.
+ */
+reg_bank_t *regbank_current(void);
+
+/**
+ * Get the default bank.
+ */
+reg_bank_t *regbank_default(void);
+
+/**
+ * Get the current index of the selected bank. Only to be called inside
+ * a read-side critical section, and the index is not to be used after
+ * it.
+ */
+const reg_index_t *regindex_get(void);
+
+/**
+ * Find the position of the last register whose ref is not greater
+ * than a given ref.
+ * @return the position, or negative if there is none.
+ */
+int regindex_lookup(const reg_index_t *idx, mb_ref_t ref);
+
+/**
+ * Tell if a register is one of the .register section.
+ */
+int regindex_static(const reg_t *reg);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGINDEX_H */
@@ -5,34 +5,566 @@
 /*********************
  *      INCLUDES
  *********************/
+#include <string.h>
 #include "err.h"
 #include "register.h"
-
-extern uint32_t __register_start;
-extern uint32_t __register_end;
+#include "regchange.h"
+#include "regindex.h"
+#include "regprof.h"
+#include "regcache.h"
+#include "trace.h"
 
 /**********************
  *  STATIC VARIABLES
  **********************/
-static const reg_t *reg_start = (const reg_t *) &__register_start;
-static const reg_t *reg_end = (const reg_t *) &__register_end;
-static regstore_cb_t store_cb;
+
+#if YAM_REG_SHADOW
+#define SHADOW_MAP_WORDS    ((YAM_REG_SHADOW_REF_NUM + 31) / 32 + 1)
+
+static char shadow[YAM_REG_SHADOW_REF_NUM * 2];
+static uint32_t shadow_valid[SHADOW_MAP_WORDS];   /* published refs */
+static uint32_t shadow_cont[SHADOW_MAP_WORDS];    /* non-first refs */
+#endif
 
 /**********************
  *   STAITC FUNCTIONS
  **********************/
 static inline int read_reg(const reg_t *reg, regval_t *val)
 {
+    const regstore_cb_t *store_cb = &regbank_current()->store_cb;
+
     val->tag = reg->tag;
-    if (! store_cb.load_register) return -REG_ERR_INTERNAL;
-    return store_cb.load_register(val, reg->ref);
+    if (! store_cb->load_register) return -REG_ERR_INTERNAL;
+    return store_cb->load_register(val, reg->ref);
 }
 
 static inline int
 write_reg(const reg_t *reg, const regval_t *val)
 {
-    if (! store_cb.save_register) return -REG_ERR_INTERNAL;
-    return store_cb.save_register(val, reg->ref);
+    const regstore_cb_t *store_cb = &regbank_current()->store_cb;
+
+    if (! store_cb->save_register) return -REG_ERR_INTERNAL;
+    return store_cb->save_register(val, reg->ref);
+}
+
+#if YAM_REG_SHADOW
+/* registers sharing a word of the bitmaps are published concurrently */
+#define shadow_word(map, ref) (&(map)[((ref) - YAM_REG_SHADOW_REF_FIRST) / 32])
+#define shadow_bit(ref) (1u << (((ref) - YAM_REG_SHADOW_REF_FIRST) % 32))
+#define shadow_test(map, ref) \
+    (__atomic_load_n(shadow_word(map, ref), __ATOMIC_RELAXED) \
+     & shadow_bit(ref))
+#define shadow_set(map, ref) \
+    __atomic_fetch_or(shadow_word(map, ref), shadow_bit(ref), \
+            __ATOMIC_RELAXED)
+#define shadow_clear(map, ref) \
+    __atomic_fetch_and(shadow_word(map, ref), ~shadow_bit(ref), \
+            __ATOMIC_RELAXED)
+#define shadow_buf(ref) (shadow + ((ref) - YAM_REG_SHADOW_REF_FIRST) * 2)
+
+static inline int in_shadow_window(mb_ref_t ref, uint16_t count)
+{
+    return ref >= YAM_REG_SHADOW_REF_FIRST
+        && ref + count <= YAM_REG_SHADOW_REF_FIRST + YAM_REG_SHADOW_REF_NUM;
+}
+
+/**
+ * The shadow image belongs to the default bank.
+ */
+static inline int shadowed(const reg_t *reg)
+{
+    return in_shadow_window(reg->ref, reg->size)
+        && regbank_current() == regbank_default()
+        && shadow_test(shadow_valid, reg->ref);
+}
+
+static inline int shadow_order(const reg_t *reg)
+{
+    return reg->byte_order ? reg->byte_order : regbank_default()->byte_order;
+}
+
+static inline int shadow_encode(const reg_t *reg, const regval_t *val)
+{
+    return regval_encode_mb_codec(regval_codec_id(reg->tag, reg->size),
+            shadow_order(reg), val, shadow_buf(reg->ref), reg_mb_scale(reg));
+}
+
+static inline int shadow_decode(const reg_t *reg, regval_t *val)
+{
+    return regval_decode_mb_codec(regval_codec_id(reg->tag, reg->size),
+            shadow_order(reg), shadow_buf(reg->ref), val, reg_mb_scale(reg));
+}
+
+/**
+ * Re-encode a written value into the shadow image, if the register
+ * is published.
+ */
+static inline void shadow_update(const reg_t *reg, const regval_t *val)
+{
+    if (shadowed(reg)) shadow_encode(reg, val);
+}
+#else
+#define shadowed(reg) ((void)(reg), 0)
+#define shadow_update(reg, val) ((void)(reg), (void)(val))
+#endif
+
+#if YAM_TRACE
+/**
+ * Evaluate a store or callback call, traced as a TRACE_STORE stage.
+ */
+#define traced(refs, call) ({ \
+    int __e; \
+    trace_begin(TRACE_STORE, *(refs)); \
+    __e = (call); \
+    trace_end(TRACE_STORE, *(refs)); \
+    __e; })
+#else
+#define traced(refs, call) (call)
+#endif
+
+#if YAM_REG_PROFILE
+/**
+ * Evaluate a load or a save of registers, counting it with the time
+ * it took. A negative result counts as an error, as for its callers,
+ * and a load is counted once, snapshot reads don't call it again.
+ */
+#define profiled(refs, n, write, call) ({ \
+    uint64_t __t = register_prof_clock(); \
+    int __err = traced((refs), call); \
+    register_prof_count((refs), (n), (write), __err, \
+            register_prof_clock() - __t); \
+    __err; })
+#define prof_error(ref, write) \
+    register_prof_count(&(mb_ref_t){ (ref) }, 1, (write), -1, 0)
+#else
+#define profiled(refs, n, write, call) traced((refs), call)
+#define prof_error(ref, write) ((void)(ref), (void)(write))
+#endif
+
+/**
+ * Bookkeeping after a new value of a register, or of the element of an
+ * array at ref, has been saved.
+ */
+static inline void reg_written(const reg_t *reg, mb_ref_t ref,
+        const regval_t *val)
+{
+    shadow_update(reg, val);
+#if YAM_REG_CACHE && YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+    if (reg->read_cb) register_cache_drop(reg);
+#endif
+#if YAM_REG_CHANGE_TRACKING
+    /* only changes of the default bank are tracked */
+    if (regbank_current() == regbank_default())
+        yam_reg_mark_changed(ref);
+#else
+    (void)ref;
+#endif
+}
+
+#if YAM_REG_ARRAY
+#define is_array(reg) (reg_count(reg) != 0)
+/* an array whose elements are in its data */
+#define in_data(reg) (is_array(reg) && (reg)->array->data)
+#else
+#define is_array(reg) ((void)(reg), 0)
+#define in_data(reg) 0
+#endif
+
+/**
+ * Tell if a register is loaded by the store, rather than by its own
+ * read_cb or from the shadow image.
+ */
+static inline int store_backed(const reg_t *reg)
+{
+    if (is_array(reg)) return 0;
+#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+    if (reg->read_cb) return 0;
+#endif
+    return ! shadowed(reg);
+}
+
+#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+static inline int load_cb(const reg_t *reg, regval_t *val)
+{
+#if YAM_REG_CACHE
+    int err;
+
+    if (! register_cache_load(reg, val)) return 0;
+    if ((err = reg->read_cb(reg, val)) >= 0) register_cache_fill(reg, val);
+    return err;
+#else
+    return reg->read_cb(reg, val);
+#endif
+}
+#endif
+
+static inline int load_reg(const reg_t *reg, regval_t *val)
+{
+#if YAM_REG_SHADOW
+    if (shadowed(reg))
+        return shadow_decode(reg, val) ? -REG_ERR_INTERNAL : 0;
+#endif
+#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+    if (reg->read_cb) return load_cb(reg, val);
+#endif
+    return read_reg(reg, val);
+}
+
+/**
+ * Tell if reading a register calls the application, its read_cb or the
+ * read_block of its array, rather than the store or the shadow image.
+ */
+static inline int calls_back(const reg_t *reg)
+{
+    if (shadowed(reg)) return 0;
+#if YAM_REG_ARRAY
+    if (is_array(reg)) return ! reg->array->data;
+#endif
+#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+    if (reg->read_cb) return 1;
+#endif
+    return 0;
+}
+
+/**
+ * Load a run of registers none of which has a read_cb, with a single
+ * store call if the store can do that.
+ */
+static int load_reg_run(const reg_t **regs, regval_t *vals,
+        const mb_ref_t *refs, size_t n)
+{
+    const regstore_cb_t *store_cb = &regbank_current()->store_cb;
+    size_t i;
+    int err;
+
+    if (store_cb->load_registers)
+        return store_cb->load_registers(vals, refs, n);
+
+    for (i = 0; i < n; ++i)
+        if ((err = read_reg(regs[i], &vals[i])) < 0) return err;
+    return 0;
+}
+
+/**
+ * Save a register, through its write_cb if it has one.
+ * @return negative if error.
+ */
+static inline int store_reg(const reg_t *reg, const regval_t *val)
+{
+#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+    int err;
+
+    /* a write_cb fails on any nonzero return, a positive one is the
+     * code of the error, so the callers and the profile count the
+     * failures alike
+     */
+    if (reg->write_cb)
+        return (err = reg->write_cb(reg, val)) > 0 ? -err : err;
+#endif
+    return write_reg(reg, val);
+}
+
+/**
+ * Save a run of registers none of which has a write_cb, with a single
+ * store call if the store can do that.
+ */
+static int save_reg_run(const reg_t **regs, const regval_t *vals,
+        const mb_ref_t *refs, size_t n)
+{
+    const regstore_cb_t *store_cb = &regbank_current()->store_cb;
+    size_t i;
+    int err;
+
+    if (store_cb->save_registers)
+        return store_cb->save_registers(vals, refs, n);
+
+    for (i = 0; i < n; ++i)
+        if ((err = write_reg(regs[i], &vals[i])) < 0) return err;
+    return 0;
+}
+
+#if YAM_REG_ARRAY
+/**
+ * Load n elements of an array register, from the one at ref on.
+ */
+static int load_block(const reg_t *reg, mb_ref_t ref, regval_t *vals,
+        unsigned int n)
+{
+    const reg_array_t *a = reg->array;
+    unsigned int first = (ref - reg->ref) / reg->size;
+
+    if (a->data) {
+        memcpy(vals, a->data + first, n * sizeof(regval_t));
+        return 0;
+    }
+    if (! a->read_block) return -REG_ERR_INTERNAL;
+    return a->read_block(reg, first, vals, n);
+}
+
+/**
+ * Save n elements of an array register, from the one at ref on.
+ */
+static int save_block(const reg_t *reg, mb_ref_t ref, const regval_t *vals,
+        unsigned int n)
+{
+    const reg_array_t *a = reg->array;
+    unsigned int first = (ref - reg->ref) / reg->size;
+
+    if (a->data) {
+        memcpy(a->data + first, vals, n * sizeof(regval_t));
+        return 0;
+    }
+    if (! a->write_block) return -REG_ERR_INTERNAL;
+    return a->write_block(reg, first, vals, n);
+}
+
+/**
+ * Number of items from i on which are elements of the same array.
+ */
+static inline int block_len(const reg_t **regs, int i, int n)
+{
+    int j;
+
+    for (j = i + 1; j < n && regs[j] == regs[i]; ++j);
+    return j - i;
+}
+#endif
+
+static int load_range(const reg_t **regs, regval_t *vals,
+        const mb_ref_t *refs, int n)
+{
+    int i, run;
+    int err;
+
+    /* registers with a read_cb or in the shadow image are read one by
+     * one, the store backed ones between them are loaded run by run,
+     * and the elements of an array block by block.
+     */
+    for (i = 0, run = 0; i <= n; ++i) {
+        if (i < n && store_backed(regs[i])) continue;
+        if (i > run && (err = profiled(refs + run, i - run, 0,
+                        load_reg_run(regs + run, vals + run,
+                            refs + run, i - run))) < 0)
+            return err;
+#if YAM_REG_ARRAY
+        if (i < n && is_array(regs[i])) {
+            run = block_len(regs, i, n);
+            if ((err = profiled(&refs[i], run, 0,
+                            load_block(regs[i], refs[i], &vals[i], run))) < 0)
+                return err;
+            i += run - 1;
+            run = i + 1;
+            continue;
+        }
+#endif
+        if (i < n && (err = profiled(&refs[i], 1, 0,
+                        load_reg(regs[i], &vals[i]))) < 0)
+            return err;
+        run = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * Save a range through the store and the callbacks, the arrays with
+ * their elements in data are left to publish_range().
+ */
+static int save_range(const reg_t **regs, const regval_t *vals,
+        const mb_ref_t *refs, int n)
+{
+    int i, run;
+    int err;
+
+    for (i = 0, run = 0; i <= n; ++i) {
+#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
+        if (i < n && ! regs[i]->write_cb && ! is_array(regs[i])) continue;
+#else
+        if (i < n && ! is_array(regs[i])) continue;
+#endif
+        if (i > run && (err = profiled(refs + run, i - run, 1,
+                        save_reg_run(regs + run, vals + run,
+                            refs + run, i - run))) < 0)
+            return err;
+#if YAM_REG_ARRAY
+        if (i < n && is_array(regs[i])) {
+            run = block_len(regs, i, n);
+            if (! in_data(regs[i]) && (err = profiled(&refs[i], run, 1,
+                            save_block(regs[i], refs[i], &vals[i], run))) < 0)
+                return err;
+            i += run - 1;
+            run = i + 1;
+            continue;
+        }
+#endif
+        if (i < n && (err = profiled(&refs[i], 1, 1,
+                        store_reg(regs[i], &vals[i]))) < 0)
+            return err;
+        run = i + 1;
+    }
+    return 0;
+}
+
+/**
+ * Publish a range saved by save_range(): the elements of the arrays
+ * with data are copied in, and the shadow image, the cache and the
+ * change tracking are updated. It's the only part of a write inside
+ * the bank's writer section, the store calls are done by then.
+ */
+static void publish_range(const reg_t **regs, const regval_t *vals,
+        const mb_ref_t *refs, int n)
+{
+    int i;
+
+    yam_reg_update_begin(regbank_current());
+    for (i = 0; i < n; ++i) {
+#if YAM_REG_ARRAY
+        if (in_data(regs[i]) && (! i || regs[i - 1] != regs[i]))
+            profiled(&refs[i], block_len(regs, i, n), 1,
+                    save_block(regs[i], refs[i], &vals[i],
+                        block_len(regs, i, n)));
+#endif
+        reg_written(regs[i], refs[i], &vals[i]);
+    }
+    yam_reg_update_end(regbank_current());
+}
+
+/**
+ * Find the registers of a range, only the hot entries of the index are
+ * scanned. The elements of an array register in the range are found by
+ * arithmetic, they are listed one by one with the array's entries.
+ * @param refs filled with the ref of each register or element.
+ * @param hot filled with the hot entry of each register or element.
+ */
+static int find_range(const reg_index_t *idx, mb_ref_t start,
+        uint16_t count, const reg_t **regs, mb_ref_t *refs,
+        const reg_hot_t **hot)
+{
+    const reg_hot_t *h;
+    unsigned int k = 0, end = 1;
+    int n = 0, pos;
+
+    if (count > REG_RANGE_MAX) return -REG_ERR_ADDRESS_NOT_FOUND;
+    if ((pos = regindex_lookup(idx, start)) < 0)
+        return -REG_ERR_ADDRESS_NOT_FOUND;
+
+    /* registers of the range are next to each other in the index */
+    for (h = &idx->hot[pos]; count; ++h, ++pos) {
+        if ((size_t)pos >= idx->n) return -REG_ERR_ADDRESS_NOT_FOUND;
+        if (h->count) {
+            k = (start - h->ref) / h->size;
+            end = h->count;
+            if (start < h->ref || k >= end
+                    || start != h->ref + k * h->size)
+                return -REG_ERR_ADDRESS_NOT_FOUND;
+        } else if (h->ref != start) return -REG_ERR_ADDRESS_NOT_FOUND;
+
+        for (; k < end && count; ++k) {
+            if (h->size > count) return -REG_ERR_ADDRESS_NOT_FOUND;
+            regs[n] = idx->regs[pos];
+            refs[n] = start;
+            hot[n++] = h;
+            start += h->size;
+            count -= h->size;
+        }
+        k = 0;
+        end = 1;
+    }
+    return n;
+}
+
+#if YAM_REG_SNAPSHOT_READ
+static inline int in_memory(const reg_t *reg)
+{
+    return in_data(reg) || shadowed(reg);
+}
+
+/**
+ * Copy again the values of a range kept in memory by the register
+ * layer, the elements of arrays with data and the shadow image.
+ */
+static void load_memory(const reg_t **regs, regval_t *vals,
+        const mb_ref_t *refs, int n)
+{
+    int i, run;
+
+#if ! YAM_REG_ARRAY
+    (void)refs;
+#if ! YAM_REG_SHADOW
+    (void)regs;
+    (void)vals;
+#endif
+#endif
+    for (i = 0; i < n; i += run) {
+        run = 1;
+#if YAM_REG_ARRAY
+        if (in_data(regs[i])) {
+            run = block_len(regs, i, n);
+            load_block(regs[i], refs[i], &vals[i], run);
+            continue;
+        }
+#endif
+#if YAM_REG_SHADOW
+        if (shadowed(regs[i])) shadow_decode(regs[i], &vals[i]);
+#endif
+    }
+}
+#endif
+
+static inline int same_codec(const reg_hot_t *a, const reg_hot_t *b)
+{
+    return a->codec == b->codec && a->mb_scale == b->mb_scale
+        && a->order == b->order;
+}
+
+/**
+ * Read the registers of a range, see register_read_range().
+ * @param hot filled with the hot entry of each register read.
+ * @param plain if set, nothing is read and the range fails when any of
+ *      its registers calls_back().
+ */
+static int read_range(const reg_index_t *idx, mb_ref_t start,
+        uint16_t count, const reg_t **regs, regval_t *vals,
+        const reg_hot_t **hot, int plain)
+{
+    mb_ref_t refs[REG_RANGE_MAX];
+    int n, i;
+    int err;
+#if YAM_REG_SNAPSHOT_READ
+    const reg_bank_t *bank = regbank_current();
+    uint32_t seq;
+#endif
+
+    trace_begin(TRACE_REG_FIND, start);
+    n = find_range(idx, start, count, regs, refs, hot);
+    trace_end(TRACE_REG_FIND, start);
+    if (n < 0) return n;
+
+    for (i = 0; i < n; ++i) {
+        if (! (hot[i]->perm & REG_PERM_RD)) {
+            prof_error(refs[i], 0);
+            return -REG_ERR_ADDRESS_NOT_FOUND;
+        }
+        if (plain && calls_back(regs[i])) return -REG_ERR_INTERNAL;
+        vals[i].tag = hot[i]->tag;
+    }
+
+    err = load_range(regs, vals, refs, n);
+
+#if YAM_REG_SNAPSHOT_READ
+    /* the store and the callbacks are called once, stores which keep
+     * the values in memory copy them under the seqlock themselves, the
+     * values the register layer keeps are copied again until no update
+     * was published meanwhile
+     */
+    for (i = 0; i < n && ! in_memory(regs[i]); ++i);
+    if (! err && i < n)
+        do {
+            seq = regbank_read_begin(bank);
+            load_memory(regs + i, vals + i, refs + i, n - i);
+        } while (regbank_read_retry(bank, seq));
+#endif
+
+    return err < 0 ? err : n;
 }
 
 #if YAM_REG_RANGE_CONTROL
@@ -44,30 +576,84 @@ register_chk_value_range(const reg_t *reg, const regval_t *val)
 }
 #endif
 
+/**
+ * Check if a value is allowed to be written to a register.
+ */
+static inline int chk_write(const reg_t *reg, mb_ref_t ref,
+        const regval_t *val)
+{
+    int err = 0;
+
+    if (! (reg->perm & REG_PERM_WR)) err = -REG_ERR_ADDRESS_NOT_FOUND;
+#if YAM_REG_RANGE_CONTROL
+    else if (register_chk_value_range(reg, val)) err = -REG_ERR_DATA_VALUE;
+#else
+    (void)val;
+#endif
+    if (err) prof_error(ref, 1);
+    return err;
+}
+
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
 void register_install_store_cb(const regstore_cb_t *_store_cb)
 {
-    store_cb = *_store_cb;
+    regbank_default()->store_cb = *_store_cb;
 }
 
 int register_find(mb_ref_t ref, int options, const reg_t **reg)
 {
-    const reg_t *i;
+    const reg_index_t *idx = regindex_get();
+    const reg_hot_t *h;
+    int pos;
 
-    if (options & OPT_BITMAP)
-        for (i = reg_start
-                ; i < reg_end && (ref < i->ref || ref >= i->ref + i->size)
-                ; ++i);
-    else
-        for (i = reg_start; i < reg_end && i->ref != ref; ++i);
+    pos = regindex_lookup(idx, ref);
+    if (pos < 0) return -1;
+    h = &idx->hot[pos];
 
-    if (i == reg_end) return -1;
-    *reg = i;
+    /* the elements of an array are not registers of their own */
+    if (h->count
+            || (options & OPT_BITMAP ? ref >= h->ref + h->size : ref != h->ref))
+        return -1;
+    *reg = idx->regs[pos];
     return 0;
 }
 
+uint32_t register_map_hash(void)
+{
+    const reg_index_t *idx;
+    const reg_hot_t *i;
+    reg_bank_t *bank;
+    uint32_t h = 2166136261u;   /* FNV-1a */
+    size_t k;
+    int token;
+
+    /* the .register section only, whatever bank the thread selected */
+    token = register_read_lock();
+    bank = register_select_bank(NULL);
+    idx = regindex_get();
+#define hash_byte(b) (h = (h ^ (uint8_t)(b)) * 16777619u)
+    for (k = 0; k < idx->n; ++k) {
+        if (! regindex_static(idx->regs[k])) continue;
+        i = &idx->hot[k];
+        hash_byte(i->ref);
+        hash_byte(i->ref >> 8);
+        hash_byte(i->size);
+        hash_byte(i->tag);
+        hash_byte(i->mb_scale);
+        if (i->count) {
+            hash_byte(i->count);
+            hash_byte(i->count >> 8);
+        }
+    }
+#undef hash_byte
+    register_select_bank(bank);
+    register_read_unlock(token);
+
+    return h;
+}
+
 int register_read(mb_ref_t ref, int options,
         const reg_t **reg, regval_t *val)
 {
@@ -76,17 +662,13 @@ int register_read(mb_ref_t ref, int options,
     if (register_find(ref, options, reg) < 0)
         return -REG_ERR_ADDRESS_NOT_FOUND;
 
-    if (! ((*reg)->perm & REG_PERM_RD)) return  -REG_ERR_ADDRESS_NOT_FOUND;
+    if (! ((*reg)->perm & REG_PERM_RD)) {
+        prof_error((*reg)->ref, 0);
+        return  -REG_ERR_ADDRESS_NOT_FOUND;
+    }
 
-#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
-    if (! (*reg)->read_cb && (err = read_reg(*reg, val)) < 0)
-        return err;
-    if ((*reg)->read_cb && (err = (*reg)->read_cb(*reg, val)))
-        return err;
-#else
-    if ((err = read_reg(*reg, val)) < 0)
+    if ((err = profiled(&(*reg)->ref, 1, 0, load_reg(*reg, val))) < 0)
         return err;
-#endif
 
     if (options & OPT_BITMAP) {
         regval_put_integer(val, val->n >> (ref - (*reg)->ref));
@@ -95,27 +677,258 @@ int register_read(mb_ref_t ref, int options,
         return (*reg)->size;
 }
 
+int register_find_range(mb_ref_t start, uint16_t count, const reg_t **regs)
+{
+    mb_ref_t refs[REG_RANGE_MAX];
+    const reg_hot_t *hot[REG_RANGE_MAX];
+
+    return find_range(regindex_get(), start, count, regs, refs, hot);
+}
+
+int register_read_range(mb_ref_t start, uint16_t count,
+        const reg_t **regs, regval_t *vals)
+{
+    const reg_hot_t *hot[REG_RANGE_MAX];
+
+    return read_range(regindex_get(), start, count, regs, vals, hot, 0);
+}
+
+/**
+ * See register_read_range_mb_heads(), heads may be NULL.
+ */
+static int read_range_mb(mb_ref_t start, uint16_t count, char *buf,
+        char *heads)
+{
+    const reg_index_t *idx = regindex_get();
+    const reg_t *regs[REG_RANGE_MAX];
+    regval_t vals[REG_RANGE_MAX];
+    const reg_hot_t *hot[REG_RANGE_MAX];
+    int n, i, j, off, err;
+
+    if ((n = read_range(idx, start, count, regs, vals, hot, heads != NULL))
+            < 0)
+        return n;
+
+    if (heads) {
+        memset(heads, 0, count + 1);
+        for (i = 0, off = 0; i < n; off += hot[i++]->size)
+            heads[off] = 1;
+        heads[count] = 1;
+    }
+
+    /* runs of registers with the same codec and scale go in bulk */
+    trace_begin(TRACE_ENCODE, start);
+    for (i = 0, err = 0; i < n && ! err; i = j) {
+        for (j = i + 1; j < n && same_codec(hot[i], hot[j]); ++j);
+        err = regval_encode_mb_bulk(hot[i]->codec, hot[i]->order, &vals[i],
+                j - i, buf, hot[i]->mb_scale);
+        buf += (j - i) * hot[i]->size * 2;
+    }
+    trace_end(TRACE_ENCODE, start);
+    return err ? -REG_ERR_ADDRESS_NOT_FOUND : 0;
+}
+
+int register_read_range_mb(mb_ref_t start, uint16_t count, char *buf)
+{
+    return read_range_mb(start, count, buf, NULL);
+}
+
+int register_read_range_mb_heads(mb_ref_t start, uint16_t count, char *buf,
+        char *heads)
+{
+    return read_range_mb(start, count, buf, heads);
+}
+
 int register_write(mb_ref_t ref, int options,
         const reg_t *reg, const regval_t *val)
 {
+    regval_t merged;
+    unsigned int off = 0;
     int err;
 
-    if (! (reg->perm & REG_PERM_WR)) return -REG_ERR_ADDRESS_NOT_FOUND;
-#if YAM_REG_RANGE_CONTROL
-    if (register_chk_value_range(reg, val)) return -REG_ERR_DATA_VALUE; 
+    /* the bits from ref on are replaced, the ones below it are kept */
+    if (options & OPT_BITMAP) {
+        off = ref - reg->ref;
+        if (ref < reg->ref || off >= reg->size || reg->size > 32)
+            return -REG_ERR_ADDRESS_NOT_FOUND;
+        if (off) {
+            merged.tag = reg->tag;
+            if ((err = profiled(&reg->ref, 1, 0, load_reg(reg, &merged))) < 0)
+                return err;
+            regval_put_integer(&merged,
+                    (merged.n & ((1u << off) - 1)) | (val->n << off));
+            val = &merged;
+        }
+    }
+
+    if ((err = chk_write(reg, reg->ref, val)) < 0) return err;
+
+    if ((err = profiled(&reg->ref, 1, 1, store_reg(reg, val))) < 0)
+        return err;
+    publish_range(&reg, val, &reg->ref, 1);
+
+    return reg->size - off;
+}
+
+/**
+ * Write the registers or the elements at refs, see register_write_range().
+ */
+static int write_range(const reg_t **regs, const mb_ref_t *refs,
+        const regval_t *vals, int n)
+{
+    int i;
+    int err;
+
+    /* validate all before applying any */
+    for (i = 0; i < n; ++i)
+        if ((err = chk_write(regs[i], refs[i], &vals[i])) < 0) return err;
+
+    if ((err = save_range(regs, vals, refs, n)) < 0) return err;
+    publish_range(regs, vals, refs, n);
+
+    return n;
+}
+
+int register_write_range(const reg_t **regs, const regval_t *vals, int n)
+{
+    mb_ref_t refs[REG_RANGE_MAX];
+    int i;
+
+    if (n > REG_RANGE_MAX) return -REG_ERR_ADDRESS_NOT_FOUND;
+
+    /* the elements of an array can't be told apart by the regs */
+    for (i = 0; i < n; ++i) {
+        if (is_array(regs[i])) return -REG_ERR_ADDRESS_NOT_FOUND;
+        refs[i] = regs[i]->ref;
+    }
+    return write_range(regs, refs, vals, n);
+}
+
+int register_write_range_mb(mb_ref_t start, uint16_t count, const char *buf)
+{
+    const reg_index_t *idx = regindex_get();
+    const reg_t *regs[REG_RANGE_MAX];
+    mb_ref_t refs[REG_RANGE_MAX];
+    regval_t vals[REG_RANGE_MAX];
+    const reg_hot_t *hot[REG_RANGE_MAX];
+    int n, i, j, err;
+
+    trace_begin(TRACE_REG_FIND, start);
+    n = find_range(idx, start, count, regs, refs, hot);
+    trace_end(TRACE_REG_FIND, start);
+    if (n < 0) return n;
+
+    /* decode the whole range before anything is written */
+    trace_begin(TRACE_DECODE, start);
+    for (i = 0, err = 0; i < n && ! err; i = j) {
+        for (j = i + 1; j < n && same_codec(hot[i], hot[j]); ++j);
+        err = regval_decode_mb_bulk(hot[i]->codec, hot[i]->order, buf,
+                &vals[i], j - i, hot[i]->mb_scale);
+        buf += (j - i) * hot[i]->size * 2;
+    }
+    trace_end(TRACE_DECODE, start);
+    if (err) return -REG_ERR_ADDRESS_NOT_FOUND;
+
+    return (n = write_range(regs, refs, vals, n)) < 0 ? n : 0;
+}
+
+#if YAM_REG_SHADOW
+int yam_reg_publish(mb_ref_t ref, const regval_t *val)
+{
+    const reg_t *reg;
+    reg_bank_t *bank;
+    int i, err = 0;
+    int token;
+
+    token = register_read_lock();
+    bank = register_select_bank(NULL);
+    if (register_find(ref, 0, &reg) < 0 || ! (reg->perm & REG_PERM_RD)
+            || ! in_shadow_window(ref, reg->size)) {
+        err = -REG_ERR_ADDRESS_NOT_FOUND;
+        goto out;
+    }
+
+    /* a snapshot read sees the octets and the bits of one publish */
+    yam_reg_update_begin(NULL);
+    err = shadow_encode(reg, val);
+    if (! err)
+        for (i = ref; i < ref + reg->size; ++i) {
+            if (i != ref) shadow_set(shadow_cont, i);
+            shadow_set(shadow_valid, i);
+        }
+    yam_reg_update_end(NULL);
+    if (err) {
+        err = -REG_ERR_DATA_VALUE;
+        goto out;
+    }
+
+#if YAM_REG_CHANGE_TRACKING
+    yam_reg_mark_changed(ref);
 #endif
 
-#if YAM_REG_LOAD_STORE_SPECIAL_HANDLING
-    if (! reg->write_cb)
-        return (err = write_reg(reg, val)) < 0
-            ? err : reg->size;
-    else
-        return (err = reg->write_cb(reg, val))
-            ? err : reg->size;
-#else
-    return (err = write_reg(reg, val)) < 0
-        ? err : reg->size;
+out:
+    register_select_bank(bank);
+    register_read_unlock(token);
+    return err;
+}
+
+void yam_reg_unpublish(mb_ref_t ref)
+{
+    const reg_t *reg;
+    reg_bank_t *bank;
+    int i;
+    int token;
+
+    token = register_read_lock();
+    bank = register_select_bank(NULL);
+    if (register_find(ref, 0, &reg) == 0 && in_shadow_window(ref, reg->size)) {
+        yam_reg_update_begin(NULL);
+        for (i = ref; i < ref + reg->size; ++i) {
+            shadow_clear(shadow_valid, i);
+            shadow_clear(shadow_cont, i);
+        }
+        yam_reg_update_end(NULL);
+    }
+    register_select_bank(bank);
+    register_read_unlock(token);
+}
+
+/**
+ * Whether a range holds whole published registers.
+ */
+static int shadow_range_valid(mb_ref_t start, uint16_t count)
+{
+    int i;
+
+    /* the ref after the range is still inside the bitmaps */
+    if (shadow_test(shadow_cont, start) || shadow_test(shadow_cont, start + count))
+        return 0;
+    for (i = start; i < start + count; ++i)
+        if (! shadow_test(shadow_valid, i)) return 0;
+    return 1;
+}
+
+int register_shadow_read(mb_ref_t start, uint16_t count, char *buf)
+{
+#if YAM_REG_SNAPSHOT_READ
+    uint32_t seq;
 #endif
 
-    /*TODO: for OPT_BITMAP */
+    if (! count || ! in_shadow_window(start, count)
+            || regbank_current() != regbank_default())
+        return -1;
+
+#if YAM_REG_SNAPSHOT_READ
+    /* the bits are checked with the copy, as a publish sets both */
+    do {
+        seq = regbank_read_begin(regbank_default());
+        if (! shadow_range_valid(start, count)) return -1;
+        memcpy(buf, shadow_buf(start), count * 2);
+    } while (regbank_read_retry(regbank_default(), seq));
+#else
+    if (! shadow_range_valid(start, count)) return -1;
+    memcpy(buf, shadow_buf(start), count * 2);
+#endif
+    return 0;
 }
+#endif
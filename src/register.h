@@ -8,6 +8,7 @@
 /*********************
  *      INCLUDES
  *********************/
+#include <stddef.h>
 #include <stdint.h>
 #include "../options.h"
 #include "regval.h"
@@ -22,6 +23,16 @@
 
 #define OPT_BITMAP              1
 
+/* first ref of each modbus data table */
+#define COILS_REF_FIRST             1
+#define DISCRETE_INPUT_REF_FIRST    10001
+#define INPUT_REGS_REF_FIRST        30001
+#define HOLDING_REGS_REF_FIRST      40001
+
+/* max number of registers a range operation can cover, the most a
+ * single modbus read request (FC3) can ask for */
+#define REG_RANGE_MAX           125
+
 /**********************
  *      TYPEDEFS
  **********************/
@@ -32,6 +43,25 @@ struct _reg;
 
 typedef int (* rd_reg_t)(const struct _reg *, regval_t *val);
 typedef int (* wr_reg_t)(const struct _reg *, const regval_t *val);
+#if YAM_REG_ARRAY
+/* n elements of an array register, from element first on */
+typedef int (* rd_block_t)(const struct _reg *, unsigned int first,
+        regval_t *vals, unsigned int n);
+typedef int (* wr_block_t)(const struct _reg *, unsigned int first,
+        const regval_t *vals, unsigned int n);
+
+/**
+ * Elements of an array register, see reg_t. The values are in data, or
+ * moved by the block callbacks if data is NULL, which return negative
+ * on error.
+ */
+typedef struct {
+    uint16_t count;
+    regval_t *data;
+    rd_block_t read_block;
+    wr_block_t write_block;
+} reg_array_t;
+#endif
 
 typedef struct _reg {
     /* five decimal digits of reference id, e.g., 40001 */ 
@@ -44,7 +74,7 @@ typedef struct _reg {
     type_tag_t tag;
 
     int8_t mb_scale         :5;  /* -16 to 15. value = mb-vale x 10^scale */
-    int8_t reserved         :3;
+    uint8_t byte_order      :3;  /* REGVAL_ORDER_*, 0 for the bank's */
     int8_t perm             :2;  /* bits xx = RW */
 #if YAM_REG_RANGE_CONTROL
     int8_t lower_bound      :1;  /* 'min' takes effect */
@@ -54,6 +84,16 @@ typedef struct _reg {
     float max;
 #endif
 
+#if YAM_REG_ARRAY
+    /**
+     * When array is set and its count is not zero the register is an
+     * array of count elements of tag and size, element i at
+     * ref + i * size. Arrays are read and written by the range functions
+     * only.
+     */
+    const reg_array_t *array;
+#endif
+
     /**
      * load/store callbacks, when appears, provide
      * customized load/store service.
@@ -70,6 +110,28 @@ typedef struct _reg {
 typedef struct {
     int (* load_register)(regval_t *val, mb_ref_t ref);
     int (* save_register)(const regval_t *val, mb_ref_t ref);
+
+    /**
+     * Optional. Load a batch of registers in one call, vals[i] is
+     * to be filled with the value of refs[i]. As with load_register,
+     * the tag of each val is already set when it's called.
+     */
+    int (* load_registers)(regval_t *vals, const mb_ref_t *refs, size_t n);
+
+    /**
+     * Optional. Save a batch of registers in one call, vals[i] is the
+     * new value of refs[i]. All the values have been validated before
+     * it's called, so a store can apply them atomically and make them
+     * durable with a single flush.
+     *
+     * With YAM_REG_SNAPSHOT_READ, the callbacks are called outside the
+     * bank's seqlock, a store keeping its values in memory brackets the
+     * copy of saved values with yam_reg_update_begin() and
+     * yam_reg_update_end(), and copies loaded values in a
+     * regbank_read_begin() / regbank_read_retry() loop.
+     */
+    int (* save_registers)(const regval_t *vals, const mb_ref_t *refs,
+            size_t n);
 } regstore_cb_t;
 
 /**********************
@@ -80,7 +142,7 @@ extern "C" {
 #endif
 
 /**
- * Install store callback methods.
+ * Install store callback methods of the default bank.
  * @param store_cb it contains store callback methods: load_register and
  *                 save_register.
  */
@@ -100,11 +162,135 @@ void register_install_store_cb(const regstore_cb_t *store_cb);
 int register_read(mb_ref_t ref, int options,
         const reg_t **reg, regval_t *val);
 
+/**
+ * Write register value.
+ * @param ref ref of the register.
+ * @param options if contains OPT_BITMAP means the ref is referencing
+ *                a coil, the bits of val replace the ones of the
+ *                register from ref on, the bits below ref are kept.
+ * @param reg the register, e.g., from register_find().
+ * @param val the new value.
+ * @return how many actual ref's that was written, or negative if error.
+ */
 int register_write(mb_ref_t ref, int options,
         const reg_t *reg, const regval_t *val);
 
+/**
+ * Write a batch of registers with validate-then-apply semantics: the
+ * permission and value range of every register are checked first, and
+ * nothing is written if any of them fails. Registers without a
+ * write_cb are then committed through one save_registers call when the
+ * store provides it.
+ * @param regs the registers to write, e.g., from register_find_range().
+ * @param vals new values of the registers.
+ * @param n number of registers, not more than REG_RANGE_MAX.
+ * @return n on success, or negative if error, e.g., an array register
+ *         is among them, use register_write_range_mb() for those.
+ */
+int register_write_range(const reg_t **regs, const regval_t *vals, int n);
+
 int register_find(mb_ref_t ref, int options, const reg_t **reg);
 
+/**
+ * Calculate a hash of the register map layout, i.e., ref, size, tag
+ * and scale of the registers of the .register section. Runtime tables
+ * and the bank selected in the calling thread don't change it, so
+ * stores which persist register values can use it to detect a layout
+ * change of the firmware.
+ * @return the hash value.
+ */
+uint32_t register_map_hash(void);
+
+/**
+ * Find the registers which exactly cover a range of refs.
+ * @param start the first ref of the range.
+ * @param count number of refs in the range, not more than REG_RANGE_MAX.
+ * @param regs filled with the matched registers, in the order of refs.
+ *      An array register is listed once for each element in the range.
+ * @return number of registers found, or negative if any ref in the
+ *         range is not addressable or a register crosses the end
+ *         of the range.
+ */
+int register_find_range(mb_ref_t start, uint16_t count, const reg_t **regs);
+
+/**
+ * Read all the registers covering a range of refs.
+ * Registers without a read_cb are loaded with as few store calls as
+ * possible: one single load_registers call when the store provides
+ * it and none of the registers has a read_cb.
+ * @param start the first ref of the range.
+ * @param count number of refs in the range, not more than REG_RANGE_MAX.
+ * @param regs filled with the matched registers.
+ * @param vals filled with values of the matched registers.
+ * @return number of registers read, or negative if error.
+ */
+int register_read_range(mb_ref_t start, uint16_t count,
+        const reg_t **regs, regval_t *vals);
+
+/**
+ * Read a range as register_read_range() does and encode it in modbus
+ * order, with the codec each register resolved when it was indexed.
+ * @param buf filled with count * 2 octets.
+ * @return zero on success, or negative if error.
+ */
+int register_read_range_mb(mb_ref_t start, uint16_t count, char *buf);
+
+/**
+ * Read a range as register_read_range_mb() does, and mark where its
+ * registers start, so a part of the range which starts and ends on
+ * them can be served from buf as if it was read alone. That holds for
+ * registers read from the store or the shadow image only, the range
+ * fails without reading anything if a register has a read_cb or is
+ * an array with a read_block, whose calls would not be the same.
+ * @param heads filled with count + 1 flags, heads[i] is set if ref
+ *      start + i is the first of a register or element, or the end of
+ *      the range.
+ * @return zero on success, or negative if error.
+ */
+int register_read_range_mb_heads(mb_ref_t start, uint16_t count, char *buf,
+        char *heads);
+
+/**
+ * Decode a range in modbus order with the codecs resolved when the
+ * registers were indexed, and write it as register_write_range() does.
+ * Nothing is written if any value fails to decode.
+ * @param buf count * 2 octets.
+ * @return zero on success, or negative if error.
+ */
+int register_write_range_mb(mb_ref_t start, uint16_t count, const char *buf);
+
+#if YAM_REG_SHADOW
+/**
+ * Publish a new value of a register of the default bank into the shadow
+ * image. From then
+ * on the register is read from the shadow image, which holds it already
+ * encoded, and reads covering only published registers are served by
+ * a copy of the image. A write to the register from the master also
+ * updates the image.
+ * @param ref ref of the register, which must be inside the shadow window.
+ * @param val the new value.
+ * @return zero on success, or negative if error.
+ */
+int yam_reg_publish(mb_ref_t ref, const regval_t *val);
+
+/**
+ * Stop serving a register from the shadow image, it's read from the
+ * store or its read_cb again.
+ * @param ref ref of the register.
+ */
+void yam_reg_unpublish(mb_ref_t ref);
+
+/**
+ * Copy the modbus image of a range of refs from the shadow image.
+ * @param start the first ref of the range.
+ * @param count number of refs.
+ * @param buf buffer to hold the encoded registers.
+ * @return zero on success, or negative if any ref in the range is not
+ *         published or the range splits a register.
+ */
+int register_shadow_read(mb_ref_t start, uint16_t count, char *buf);
+#endif
+
 #define REG_IO_NONE                     0
 #define REG_IO_ILLEGAL_DATA_ADDRESS     2
 #define REG_IO_ILLEGAL_DATA_VALUE       3
@@ -127,6 +313,18 @@ int register_find(mb_ref_t ref, int options, const reg_t **reg);
 #define reg_mb_scale(reg) \
     ((reg)->mb_scale >= 16 ? -(32 - (reg)->mb_scale) : (reg)->mb_scale)
 
+/**
+ * Get the number of refs a register covers, all the elements of an
+ * array register.
+ */
+#if YAM_REG_ARRAY
+#define reg_count(reg) ((reg)->array ? (reg)->array->count : 0)
+#define reg_span(reg) \
+    (reg_count(reg) ? (unsigned int)reg_count(reg) * (reg)->size : (reg)->size)
+#else
+#define reg_span(reg) ((reg)->size)
+#endif
+
 #define __register__ __attribute__ ((section(".register"))) const reg_t
 
 #endif /* __YAM_REGISTER_H */
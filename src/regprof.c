@@ -0,0 +1,167 @@
+/**
+ * @file regprof.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdlib.h>
+#include <string.h>
+#include "lib/log.h"
+#include "regprof.h"
+
+#if YAM_REG_PROFILE
+
+#ifdef __unix__
+#include <time.h>
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+#define PAGE_REFS       256
+#define PAGES           (65536 / PAGE_REFS)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t errors;
+    uint64_t time_ns;
+} counter_t;
+
+/**
+ * Pages are allocated on the first access of a ref in them.
+ */
+typedef struct {
+    counter_t counters[PAGE_REFS];
+} prof_page_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static prof_page_t *pages[PAGES];
+static char lock;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static prof_page_t *get_page(mb_ref_t ref)
+{
+    prof_page_t *page;
+
+    if ((page = __atomic_load_n(&pages[ref / PAGE_REFS], __ATOMIC_ACQUIRE)))
+        return page;
+
+    while (__atomic_test_and_set(&lock, __ATOMIC_ACQUIRE));
+    if (! (page = pages[ref / PAGE_REFS])
+            && (page = calloc(1, sizeof(prof_page_t))))
+        __atomic_store_n(&pages[ref / PAGE_REFS], page, __ATOMIC_RELEASE);
+    __atomic_clear(&lock, __ATOMIC_RELEASE);
+    return page;
+}
+
+/**
+ * Tell if a costs more than b.
+ */
+static int costlier(const reg_prof_t *a, const reg_prof_t *b)
+{
+    if (a->time_ns != b->time_ns) return a->time_ns > b->time_ns;
+    return a->reads + a->writes > b->reads + b->writes;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+uint64_t register_prof_clock(void)
+{
+#ifdef __unix__
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+void register_prof_count(const mb_ref_t *refs, size_t n, int write, int err,
+        uint64_t ns)
+{
+    prof_page_t *page;
+    counter_t *c;
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        if (! (page = get_page(refs[i]))) return;
+        c = &page->counters[refs[i] % PAGE_REFS];
+
+        if (err < 0) __atomic_fetch_add(&c->errors, 1, __ATOMIC_RELAXED);
+        else if (write) __atomic_fetch_add(&c->writes, 1, __ATOMIC_RELAXED);
+        else __atomic_fetch_add(&c->reads, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&c->time_ns, ns / n, __ATOMIC_RELAXED);
+    }
+}
+
+int yam_reg_prof_top(reg_prof_t *top, int n)
+{
+    const prof_page_t *page;
+    const counter_t *c;
+    reg_prof_t e;
+    unsigned int p, k;
+    int used = 0, i;
+
+    if (n <= 0) return 0;
+
+    for (p = 0; p < PAGES; ++p) {
+        if (! (page = __atomic_load_n(&pages[p], __ATOMIC_ACQUIRE)))
+            continue;
+
+        for (k = 0; k < PAGE_REFS; ++k) {
+            c = &page->counters[k];
+            e.ref = p * PAGE_REFS + k;
+            e.reads = __atomic_load_n(&c->reads, __ATOMIC_RELAXED);
+            e.writes = __atomic_load_n(&c->writes, __ATOMIC_RELAXED);
+            e.errors = __atomic_load_n(&c->errors, __ATOMIC_RELAXED);
+            e.time_ns = __atomic_load_n(&c->time_ns, __ATOMIC_RELAXED);
+            if (! e.reads && ! e.writes && ! e.errors) continue;
+
+            /* insert into the sorted top list */
+            if (used == n && ! costlier(&e, &top[n - 1])) continue;
+            if (used < n) ++used;
+            for (i = used - 1; i > 0 && costlier(&e, &top[i - 1]); --i)
+                top[i] = top[i - 1];
+            top[i] = e;
+        }
+    }
+    return used;
+}
+
+void yam_reg_prof_dump(int n)
+{
+    reg_prof_t *top;
+    int i;
+
+    if (n <= 0 || ! (top = malloc(n * sizeof(reg_prof_t)))) return;
+
+    n = yam_reg_prof_top(top, n);
+    for (i = 0; i < n; ++i)
+        ll_info("yam: ref %u reads %u writes %u errors %u time %lu us",
+                top[i].ref, top[i].reads, top[i].writes, top[i].errors,
+                (unsigned long)(top[i].time_ns / 1000));
+    free(top);
+}
+
+void yam_reg_prof_reset(void)
+{
+    prof_page_t *page;
+    unsigned int p;
+
+    for (p = 0; p < PAGES; ++p)
+        if ((page = __atomic_load_n(&pages[p], __ATOMIC_ACQUIRE)))
+            memset(page, 0, sizeof(prof_page_t));
+}
+
+#endif /* YAM_REG_PROFILE */
@@ -0,0 +1,85 @@
+/**
+ * @file regprof.h
+ * @brief Per-register access profiling
+ *
+ * Each read, write and failed access of a register is counted, with
+ * the time spent in its read_cb/write_cb or in the store callbacks. A
+ * batch store call is shared evenly among the registers it serves.
+ * yam_reg_prof_top() then tells which registers cost the most, e.g.,
+ * the slow callbacks worth caching, or the ranges masters should read
+ * as one block.
+ *
+ * Counters are kept per ref, accesses of all the banks are summed.
+ * Time is only measured on POSIX systems.
+ */
+
+#ifndef __YAM_REGPROF_H
+#define __YAM_REGPROF_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include "../options.h"
+#include "register.h"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    mb_ref_t ref;
+    uint32_t reads;
+    uint32_t writes;
+    uint32_t errors;
+    uint64_t time_ns;       /* in callbacks */
+} reg_prof_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if YAM_REG_PROFILE
+/**
+ * Get the registers which cost the most.
+ * @param top filled with the counters of the registers, by time spent
+ *      and then by number of accesses, the most first.
+ * @param n size of top.
+ * @return number of entries filled.
+ */
+int yam_reg_prof_top(reg_prof_t *top, int n);
+
+/**
+ * Log the top n registers, as yam_reg_prof_top().
+ */
+void yam_reg_prof_dump(int n);
+
+/**
+ * Clear all the counters.
+ */
+void yam_reg_prof_reset(void);
+
+/**
+ * Monotonic time for the profiler.
+ */
+uint64_t register_prof_clock(void);
+
+/**
+ * Count an access of registers, called by the register layer.
+ * @param refs refs of the registers.
+ * @param n number of registers.
+ * @param write nonzero if they were written.
+ * @param err result of the access, negative counts as an error.
+ * @param ns time spent, shared evenly among the registers.
+ */
+void register_prof_count(const mb_ref_t *refs, size_t n, int write, int err,
+        uint64_t ns);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGPROF_H */
@@ -0,0 +1,714 @@
+/**
+ * @file regstore_journal.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "../options.h"
+
+#if YAM_REGSTORE_JOURNAL
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "err.h"
+#include "frame_tool.h"
+#include "regindex.h"
+#include "regstore_journal.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define FILE_MAGIC          0x59414d4a  /* "YAMJ" */
+#define FILE_VERSION        3
+#define REFS                65536       /* one value for each ref */
+#define GROUPS_MAX          16
+#define CHECKPOINT_CHUNK    64          /* entries written at a time */
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+/**
+ * Both the image and the journal begin with a header, the image has
+ * 'count' entries following, the journal has frames following.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t count;
+} file_header_t;
+
+/**
+ * The size and tag are the ones of the register the value was saved
+ * for, an entry is dropped at startup if they changed.
+ */
+typedef struct {
+    regval_t val;
+    mb_ref_t ref;
+    mb_size_t size;
+    type_tag_t tag;
+} entry_t;
+
+/**
+ * A frame holds the entries of one save, it's replayed as a whole or
+ * not at all. The entries follow the header right away, without the
+ * padding a struct of both would have.
+ */
+typedef struct {
+    uint16_t n;
+    uint16_t crc;   /* of the entries */
+} frame_header_t;
+
+typedef struct {
+    const char *group;
+    int durability;
+} group_durability_t;
+
+/**********************
+ *   STATIC PROTOTYPES
+ **********************/
+static int load_register(regval_t *val, mb_ref_t ref);
+static int save_register(const regval_t *val, mb_ref_t ref);
+static int load_registers(regval_t *vals, const mb_ref_t *refs, size_t n);
+static int save_registers(const regval_t *vals, const mb_ref_t *refs,
+        size_t n);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static regval_t *values;
+static mb_size_t *sizes;        /* of the register of each ref saved, or 0 */
+
+static char image_path[PATH_MAX];
+static char tmp_path[PATH_MAX];
+static char log_path[PATH_MAX];
+static char old_log_path[PATH_MAX]; /* the journal being checkpointed */
+static int log_fd = -1;
+static off_t log_len;           /* of the frames appended */
+static off_t synced_len;        /* of the frames made durable */
+static int old_log;             /* the old journal is still to replay */
+static int dir_unsynced;        /* the journal was created since a sync */
+static int failed;              /* the journal can't be appended to */
+
+/* the values the checkpoint in progress writes */
+static regval_t *ckpt_values;
+static mb_size_t *ckpt_sizes;
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t synced = PTHREAD_COND_INITIALIZER;
+static uint64_t appended_seq;
+static uint64_t synced_seq;
+static uint64_t lost_seq;       /* frames up to it were rolled back */
+static int syncing;
+static int checkpointing;
+static int log_records;
+static int checkpoint_records;
+
+static group_durability_t groups[GROUPS_MAX];
+static int groups_num;
+static int default_durability = REGSTORE_JOURNAL_SYNC;
+
+/**********************
+ *  GLOBAL VARIABLES
+ **********************/
+const regstore_cb_t regstore_journal_cb = {
+    .load_register = load_register,
+    .save_register = save_register,
+    .load_registers = load_registers,
+    .save_registers = save_registers,
+};
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static void init_header(file_header_t *h, uint32_t count)
+{
+    h->magic = FILE_MAGIC;
+    h->version = FILE_VERSION;
+    h->entry_size = sizeof(entry_t);
+    h->count = count;
+}
+
+static int header_valid(const file_header_t *h)
+{
+    return h->magic == FILE_MAGIC
+        && h->version == FILE_VERSION
+        && h->entry_size == sizeof(entry_t);
+}
+
+static int write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    ssize_t n;
+
+    while (len) {
+        if ((n = write(fd, p, len)) < 0) return -1;
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static ssize_t read_all(int fd, void *buf, size_t len)
+{
+    char *p = buf;
+    ssize_t n;
+
+    while (len && (n = read(fd, p, len)) > 0) {
+        p += n;
+        len -= n;
+    }
+    return p - (char *)buf;
+}
+
+/**
+ * The tag of a value kept is the one of its register, loads set their
+ * own anyway.
+ */
+static inline void apply_entry(const entry_t *e)
+{
+    values[e->ref] = e->val;
+    values[e->ref].tag = e->tag;
+    sizes[e->ref] = e->size;
+}
+
+/**
+ * Apply an entry of the image or the journal, unless the register map
+ * changed under it. Called inside a read-side critical section.
+ */
+static void replay_entry(const entry_t *e)
+{
+    const reg_t *reg;
+
+    if (register_find(e->ref, 0, &reg) < 0
+            || reg->tag != e->tag || reg->size != e->size)
+        return;
+    apply_entry(e);
+}
+
+static int durability_of(const reg_t *reg)
+{
+    int i;
+
+    if (! reg || ! reg->group)
+        return default_durability;
+    for (i = 0; i < groups_num; ++i)
+        if (! strcmp(groups[i].group, reg->group))
+            return groups[i].durability;
+    return default_durability;
+}
+
+static int sync_dir(const char *path)
+{
+    char dir[PATH_MAX];
+    char *slash;
+    int fd, err;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    if ((slash = strrchr(dir, '/'))) *(slash == dir ? slash + 1 : slash) = 0;
+    else snprintf(dir, sizeof(dir), ".");
+
+    if ((fd = open(dir, O_RDONLY)) < 0) return -1;
+    err = fsync(fd);
+    close(fd);
+    return err;
+}
+
+static int load_image(void)
+{
+    file_header_t h;
+    entry_t e;
+    uint32_t i;
+    int fd;
+
+    if ((fd = open(image_path, O_RDONLY)) < 0) return 0;
+    if (read_all(fd, &h, sizeof(h)) == sizeof(h) && header_valid(&h))
+        for (i = 0; i < h.count && read_all(fd, &e, sizeof(e)) == sizeof(e);
+                ++i)
+            replay_entry(&e);
+    close(fd);
+    return 0;
+}
+
+/**
+ * Replay the frames of a journal from the current offset on, up to the
+ * end or a torn frame.
+ * @return the offset past the last frame replayed.
+ */
+static off_t replay_frames(int fd)
+{
+    frame_header_t fh;
+    entry_t e[REG_RANGE_MAX];
+    off_t len = sizeof(file_header_t);
+    uint16_t i;
+
+    while (read_all(fd, &fh, sizeof(fh)) == sizeof(fh)
+            && fh.n <= REG_RANGE_MAX
+            && read_all(fd, e, fh.n * sizeof(entry_t))
+                == (ssize_t)(fh.n * sizeof(entry_t))
+            && modbus_crc((const char *)e, fh.n * sizeof(entry_t)) == fh.crc) {
+        for (i = 0; i < fh.n; ++i)
+            replay_entry(&e[i]);
+        log_records += fh.n;
+        len += sizeof(fh) + fh.n * sizeof(entry_t);
+    }
+    return len;
+}
+
+/**
+ * Replay the journal a checkpoint left behind, if any. Its frames are
+ * older than the image, replaying them again is harmless.
+ */
+static void replay_old_log(void)
+{
+    file_header_t h;
+    int fd;
+
+    old_log = (fd = open(old_log_path, O_RDONLY)) >= 0;
+    if (! old_log) return;
+    if (read_all(fd, &h, sizeof(h)) == sizeof(h) && header_valid(&h))
+        replay_frames(fd);
+    close(fd);
+}
+
+/**
+ * Replay the journal, a torn frame at the tail is truncated.
+ */
+static int replay_log(void)
+{
+    file_header_t h;
+
+    if (lseek(log_fd, 0, SEEK_SET) < 0) return -1;
+    log_len = synced_len = sizeof(h);
+    if (read_all(log_fd, &h, sizeof(h)) != sizeof(h) || ! header_valid(&h)) {
+        init_header(&h, 0);
+        if (ftruncate(log_fd, 0) < 0
+                || write_all(log_fd, &h, sizeof(h)) < 0
+                || fsync(log_fd) < 0)
+            return -1;
+        return 0;
+    }
+
+    log_len = synced_len = replay_frames(log_fd);
+    return ftruncate(log_fd, log_len);
+}
+
+/**
+ * Load the values from the image and the journals. Called inside a
+ * read-side critical section.
+ */
+static int load_values(void)
+{
+    memset(values, 0, REFS * sizeof(regval_t));
+    memset(sizes, 0, REFS * sizeof(mb_size_t));
+    log_records = 0;
+    load_image();
+    replay_old_log();
+    return replay_log();
+}
+
+/**
+ * Drop the frames which are not durable, from the journal and from the
+ * values, after an fsync failed: the values left are the ones a restart
+ * would find. The waiters of the frames dropped fail, the async saves
+ * among them are lost as they would be by a crash. Called with the lock
+ * held.
+ */
+static void roll_back(void)
+{
+    int token;
+
+    lost_seq = appended_seq;
+    token = register_read_lock();
+    yam_reg_update_begin(regbank_current());
+    if (ftruncate(log_fd, synced_len) < 0 || load_values() < 0)
+        failed = 1;
+    yam_reg_update_end(regbank_current());
+    register_read_unlock(token);
+}
+
+/**
+ * Wait until the frame with the given seq is durable. If no fsync is in
+ * progress, the caller does it, and all the frames appended so far are
+ * made durable by it. If it fails, they are rolled back and their saves
+ * fail. Called with the lock held.
+ */
+static int wait_durable(uint64_t seq)
+{
+    uint64_t target;
+    off_t target_len;
+    int fd, dir, err;
+
+    while (synced_seq < seq) {
+        if (seq <= lost_seq) return -REG_ERR_INTERNAL;
+        if (syncing) {
+            pthread_cond_wait(&synced, &lock);
+            continue;
+        }
+
+        target = appended_seq;
+        target_len = log_len;
+        fd = log_fd;
+        dir = dir_unsynced;
+        syncing = 1;
+        pthread_mutex_unlock(&lock);
+        err = fdatasync(fd);
+        if (! err && dir) err = sync_dir(log_path);
+        pthread_mutex_lock(&lock);
+        syncing = 0;
+        if (! err) {
+            synced_seq = target;
+            synced_len = target_len;
+            if (dir) dir_unsynced = 0;
+        } else {
+            roll_back();
+        }
+        pthread_cond_broadcast(&synced);
+        if (err) return -REG_ERR_INTERNAL;
+    }
+    return 0;
+}
+
+/**
+ * Write the values copied into an image, and replace the image with it.
+ */
+static int write_image(const regval_t *vals, const mb_size_t *szs)
+{
+    file_header_t h;
+    entry_t chunk[CHECKPOINT_CHUNK];
+    uint32_t count = 0;
+    int fd, ref, n;
+
+    for (ref = 0; ref < REFS; ++ref)
+        count += szs[ref] != 0;
+
+    if ((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+        return -REG_ERR_INTERNAL;
+    init_header(&h, count);
+    if (write_all(fd, &h, sizeof(h)) < 0) goto fail;
+
+    memset(chunk, 0, sizeof(chunk));
+    for (ref = 0, n = 0; ref < REFS; ++ref) {
+        if (! szs[ref]) continue;
+        chunk[n].val = vals[ref];
+        chunk[n].ref = ref;
+        chunk[n].size = szs[ref];
+        chunk[n].tag = vals[ref].tag;
+        if (++n == CHECKPOINT_CHUNK) {
+            if (write_all(fd, chunk, sizeof(chunk)) < 0) goto fail;
+            n = 0;
+        }
+    }
+    if (n && write_all(fd, chunk, n * sizeof(entry_t)) < 0) goto fail;
+    if (fsync(fd) < 0) goto fail;
+    close(fd);
+
+    if (rename(tmp_path, image_path) < 0 || sync_dir(image_path) < 0)
+        return -REG_ERR_INTERNAL;
+    return 0;
+
+fail:
+    close(fd);
+    unlink(tmp_path);
+    return -REG_ERR_INTERNAL;
+}
+
+/**
+ * Move the journal aside and start a new one, the frames appended from
+ * now on go to the new one. Called with the lock held, with all the
+ * frames durable.
+ */
+static int rotate_log(void)
+{
+    file_header_t h;
+    int fd;
+
+    if (rename(log_path, old_log_path) < 0) return -1;
+    init_header(&h, 0);
+    if ((fd = open(log_path, O_RDWR | O_CREAT | O_TRUNC | O_APPEND, 0644))
+            < 0 || write_all(fd, &h, sizeof(h)) < 0) {
+        if (fd >= 0) close(fd);
+        rename(old_log_path, log_path);
+        return -1;
+    }
+
+    close(log_fd);
+    log_fd = fd;
+    log_len = synced_len = sizeof(h);
+    log_records = 0;
+    old_log = 1;
+    /* the new journal is in the directory once it's synced */
+    dir_unsynced = 1;
+    return 0;
+}
+
+/**
+ * Write the values into the image and drop the journal. The values are
+ * copied and the journal is moved aside under the lock, the image is
+ * written without it, saves go on meanwhile. The old journal is dropped
+ * once the image is durable.
+ *
+ * If the old journal of a failed checkpoint is still there, the values
+ * are written with the lock held instead, the journal is then truncated.
+ * @param wait wait for a checkpoint in progress and do another one,
+ *      else leave it to that one.
+ */
+static int checkpoint(int wait)
+{
+    int err = 0;
+
+    /*
+     * The image is to hold durable frames only, see roll_back(). The
+     * lock is dropped while waiting, so all is checked again after.
+     */
+    pthread_mutex_lock(&lock);
+    for (;;) {
+        if (checkpointing) {
+            if (! wait) goto out;
+            pthread_cond_wait(&synced, &lock);
+            continue;
+        }
+        if ((err = wait_durable(appended_seq)) < 0) goto out;
+        if (! syncing && ! checkpointing) break;
+        if (syncing) pthread_cond_wait(&synced, &lock);
+    }
+
+    if (old_log) {
+        err = write_image(values, sizes);
+        if (! err && (unlink(old_log_path) < 0
+                    || ftruncate(log_fd, sizeof(file_header_t)) < 0
+                    || fsync(log_fd) < 0))
+            err = -REG_ERR_INTERNAL;
+        if (! err) {
+            old_log = 0;
+            log_len = synced_len = sizeof(file_header_t);
+            log_records = 0;
+        }
+        goto out;
+    }
+
+    memcpy(ckpt_values, values, REFS * sizeof(regval_t));
+    memcpy(ckpt_sizes, sizes, REFS * sizeof(mb_size_t));
+    if (rotate_log() < 0) {
+        err = -REG_ERR_INTERNAL;
+        goto out;
+    }
+    checkpointing = 1;
+    pthread_mutex_unlock(&lock);
+
+    err = write_image(ckpt_values, ckpt_sizes);
+
+    pthread_mutex_lock(&lock);
+    checkpointing = 0;
+    if (! err && ! unlink(old_log_path)) old_log = 0;
+    pthread_cond_broadcast(&synced);
+out:
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+static int append(const regval_t *vals, const mb_ref_t *refs, size_t n)
+{
+    entry_t e[REG_RANGE_MAX];
+    frame_header_t h;
+    char frame[sizeof(frame_header_t) + sizeof(e)];
+    size_t len = sizeof(h) + n * sizeof(entry_t);
+    const reg_t *reg;
+    int durable = 0, due;
+    uint64_t seq;
+    size_t i;
+    int err;
+
+    if (! values || n > REG_RANGE_MAX) return -REG_ERR_INTERNAL;
+
+    memset(e, 0, n * sizeof(entry_t));
+    for (i = 0; i < n; ++i) {
+        if (register_find(refs[i], 0, &reg) < 0) reg = NULL;
+        e[i].val = vals[i];
+        e[i].ref = refs[i];
+        e[i].size = reg ? reg->size : 0;
+        e[i].tag = reg ? reg->tag : 0;
+        durable |= durability_of(reg) == REGSTORE_JOURNAL_SYNC;
+    }
+    h.n = n;
+    h.crc = modbus_crc((const char *)e, n * sizeof(entry_t));
+    memcpy(frame, &h, sizeof(h));
+    memcpy(frame + sizeof(h), e, n * sizeof(entry_t));
+
+    pthread_mutex_lock(&lock);
+    if (failed) {
+        pthread_mutex_unlock(&lock);
+        return -REG_ERR_INTERNAL;
+    }
+    if (write_all(log_fd, frame, len) < 0) {
+        /* torn bytes would hide the frames appended after them */
+        if (ftruncate(log_fd, log_len) < 0) failed = 1;
+        pthread_mutex_unlock(&lock);
+        return -REG_ERR_INTERNAL;
+    }
+    log_len += len;
+    yam_reg_update_begin(regbank_current());
+    for (i = 0; i < n; ++i)
+        apply_entry(&e[i]);
+    yam_reg_update_end(regbank_current());
+    seq = ++appended_seq;
+    log_records += n;
+
+    err = durable ? wait_durable(seq) : 0;
+    due = ! err && checkpoint_records && log_records >= checkpoint_records;
+    pthread_mutex_unlock(&lock);
+
+    /* the frame is saved anyway, a failed checkpoint is tried again */
+    if (due) checkpoint(0);
+    return err;
+}
+
+static void free_values(void)
+{
+    free(values);
+    free(sizes);
+    free(ckpt_values);
+    free(ckpt_sizes);
+    values = NULL;
+    sizes = NULL;
+    ckpt_values = NULL;
+    ckpt_sizes = NULL;
+}
+
+static int load_register(regval_t *val, mb_ref_t ref)
+{
+    return load_registers(val, &ref, 1);
+}
+
+static int save_register(const regval_t *val, mb_ref_t ref)
+{
+    return append(val, &ref, 1);
+}
+
+/**
+ * Copy the values of refs, again if an append was applying its entries
+ * meanwhile.
+ */
+static int load_registers(regval_t *vals, const mb_ref_t *refs, size_t n)
+{
+    type_tag_t tag;
+    size_t i;
+#if YAM_REG_SNAPSHOT_READ
+    const reg_bank_t *bank = regbank_current();
+    uint32_t seq;
+#endif
+
+    if (! values) return -REG_ERR_INTERNAL;
+#if YAM_REG_SNAPSHOT_READ
+    do {
+        seq = regbank_read_begin(bank);
+#endif
+        for (i = 0; i < n; ++i) {
+            tag = vals[i].tag;
+            vals[i] = values[refs[i]];
+            vals[i].tag = tag;
+        }
+#if YAM_REG_SNAPSHOT_READ
+    } while (regbank_read_retry(bank, seq));
+#endif
+    return 0;
+}
+
+static int save_registers(const regval_t *vals, const mb_ref_t *refs,
+        size_t n)
+{
+    return append(vals, refs, n);
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+int regstore_journal_open(const char *path, int _checkpoint_records)
+{
+    int token, err;
+
+    if (values) return -1;
+
+    snprintf(image_path, sizeof(image_path), "%s", path);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    snprintf(log_path, sizeof(log_path), "%s.log", path);
+    snprintf(old_log_path, sizeof(old_log_path), "%s.log.old", path);
+
+    values = malloc(REFS * sizeof(regval_t));
+    sizes = malloc(REFS * sizeof(mb_size_t));
+    ckpt_values = malloc(REFS * sizeof(regval_t));
+    ckpt_sizes = malloc(REFS * sizeof(mb_size_t));
+    if (! values || ! sizes || ! ckpt_values || ! ckpt_sizes) goto fail;
+
+    /* the entries are checked against the registers of the bank */
+    token = register_read_lock();
+    err = (log_fd = open(log_path, O_RDWR | O_CREAT | O_APPEND, 0644)) < 0
+        || load_values() < 0;
+    register_read_unlock(token);
+    if (err) goto fail;
+
+    checkpoint_records = _checkpoint_records;
+    appended_seq = synced_seq = lost_seq = 0;
+    dir_unsynced = failed = 0;
+    return 0;
+
+fail:
+    if (log_fd >= 0) close(log_fd);
+    log_fd = -1;
+    free_values();
+    return -1;
+}
+
+int regstore_journal_set_durability(const char *group, int durability)
+{
+    int i;
+
+    if (! group) {
+        default_durability = durability;
+        return 0;
+    }
+
+    for (i = 0; i < groups_num && strcmp(groups[i].group, group); ++i);
+    if (i == GROUPS_MAX) return -1;
+    groups[i].group = group;
+    groups[i].durability = durability;
+    if (i == groups_num) ++groups_num;
+    return 0;
+}
+
+int regstore_journal_sync(void)
+{
+    int err;
+
+    if (! values) return -REG_ERR_INTERNAL;
+
+    pthread_mutex_lock(&lock);
+    err = wait_durable(appended_seq);
+    pthread_mutex_unlock(&lock);
+    return err;
+}
+
+int regstore_journal_checkpoint(void)
+{
+    if (! values) return -REG_ERR_INTERNAL;
+
+    return checkpoint(1);
+}
+
+void regstore_journal_close(void)
+{
+    if (log_fd < 0) return;
+
+    regstore_journal_checkpoint();
+    close(log_fd);
+    log_fd = -1;
+    free_values();
+}
+
+#endif /* YAM_REGSTORE_JOURNAL */
@@ -0,0 +1,105 @@
+/**
+ * @file regstore_journal.h
+ * @brief Register store with a write-ahead journal
+ *
+ * Register values are kept in memory. Each save appends a frame to a
+ * journal file before it returns, the saves of all the links which
+ * arrive while an fsync is in progress are made durable together by
+ * the next one (group commit). When the journal grows over a given
+ * number of records, the values are checkpointed into a compact image
+ * file: the journal is moved aside for a new one, and dropped once the
+ * image is written, saves go on meanwhile. At startup, the image is
+ * loaded and the journals are replayed on top of it.
+ *
+ * Values are kept by ref, with the size and tag of their register. At
+ * startup a value is dropped if its ref is no longer a register, or
+ * the register changed its size or tag, the others survive a change of
+ * the register map.
+ *
+ * Durability is selected per register group (reg_t.group):
+ * REGSTORE_JOURNAL_SYNC saves return after the journal is fsync'ed,
+ * REGSTORE_JOURNAL_ASYNC saves return once the frame is appended and
+ * become durable with the next fsync.
+ *
+ * A save which fails to append leaves nothing in the journal. If an
+ * fsync fails, the frames it was to make durable are dropped from the
+ * journal and from the values, the sync saves among them fail: the
+ * values left are the ones a restart would load.
+ *
+ * Note: this backend needs a POSIX system with pthreads, and is built
+ * with YAM_REGSTORE_JOURNAL.
+ */
+
+#ifndef __YAM_REGSTORE_JOURNAL_H
+#define __YAM_REGSTORE_JOURNAL_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "register.h"
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+enum {
+    REGSTORE_JOURNAL_SYNC,
+    REGSTORE_JOURNAL_ASYNC,
+};
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Store callbacks of the journal store, install them with
+ * register_install_store_cb() after regstore_journal_open().
+ */
+extern const regstore_cb_t regstore_journal_cb;
+
+/**
+ * Open the store, load the image and replay the journal. The values
+ * are checked against the registers of the bank selected in the
+ * calling thread, so its runtime tables are to be added before.
+ * @param path path of the image file, the journal is the same path
+ *      with a ".log" suffix.
+ * @param checkpoint_records checkpoint when the journal holds this many
+ *      records, zero to checkpoint only with regstore_journal_checkpoint().
+ * @return 0 on success, or negative if error.
+ */
+int regstore_journal_open(const char *path, int checkpoint_records);
+
+/**
+ * Set durability of a register group.
+ * @param group name of the group, NULL to set the default durability of
+ *      registers which are not in a configured group.
+ * @param durability REGSTORE_JOURNAL_SYNC or REGSTORE_JOURNAL_ASYNC.
+ * @return 0 on success, or negative if too many groups are configured.
+ */
+int regstore_journal_set_durability(const char *group, int durability);
+
+/**
+ * Make all the appended frames durable.
+ * @return 0 on success, or negative if error.
+ */
+int regstore_journal_sync(void);
+
+/**
+ * Write the values into the image file and drop the journal, after a
+ * checkpoint in progress if any.
+ * @return 0 on success, or negative if error.
+ */
+int regstore_journal_checkpoint(void);
+
+/**
+ * Checkpoint and close the store.
+ */
+void regstore_journal_close(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGSTORE_JOURNAL_H */
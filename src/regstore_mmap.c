@@ -0,0 +1,266 @@
+/**
+ * @file regstore_mmap.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "../options.h"
+
+#if YAM_REGSTORE_MMAP
+
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "err.h"
+#include "regindex.h"
+#include "regstore_mmap.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define IMAGE_MAGIC         0x59414d53  /* "YAMS" */
+#define IMAGE_VERSION       1
+#define IMAGE_SLOTS         65536       /* one for each ref */
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slot_size;
+    uint32_t map_hash;
+    uint32_t slots;
+} image_header_t;
+
+typedef struct {
+    image_header_t header;
+    regval_t slots[IMAGE_SLOTS];
+} image_t;
+
+/**********************
+ *   STATIC PROTOTYPES
+ **********************/
+static int load_register(regval_t *val, mb_ref_t ref);
+static int save_register(const regval_t *val, mb_ref_t ref);
+static int load_registers(regval_t *vals, const mb_ref_t *refs, size_t n);
+static int save_registers(const regval_t *vals, const mb_ref_t *refs,
+        size_t n);
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static image_t *image;
+static int sync_interval;
+/* shared by the saving threads, accessed atomically */
+static int dirty;
+static int sync_failed;
+static uint64_t last_sync_ms;
+
+/**********************
+ *  GLOBAL VARIABLES
+ **********************/
+const regstore_cb_t regstore_mmap_cb = {
+    .load_register = load_register,
+    .save_register = save_register,
+    .load_registers = load_registers,
+    .save_registers = save_registers,
+};
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static inline void load_slot(regval_t *val, mb_ref_t ref)
+{
+    type_tag_t tag = val->tag;
+
+    *val = image->slots[ref];
+    val->tag = tag;
+}
+
+/**
+ * Copy the slots of refs, again if a save was copying its values in
+ * meanwhile.
+ */
+static void load_slots(regval_t *vals, const mb_ref_t *refs, size_t n)
+{
+    size_t i;
+#if YAM_REG_SNAPSHOT_READ
+    const reg_bank_t *bank = regbank_current();
+    uint32_t seq;
+
+    do {
+        seq = regbank_read_begin(bank);
+#endif
+        for (i = 0; i < n; ++i)
+            load_slot(&vals[i], refs[i]);
+#if YAM_REG_SNAPSHOT_READ
+    } while (regbank_read_retry(bank, seq));
+#endif
+}
+
+static uint64_t clock_ms(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * msync the image if it was saved to since the last msync. A failure
+ * is kept for regstore_mmap_sync() to report, and the image stays
+ * dirty to be tried again.
+ */
+static int sync_image(void)
+{
+    if (! __atomic_exchange_n(&dirty, 0, __ATOMIC_ACQ_REL)) return 0;
+    if (msync(image, sizeof(image_t), MS_SYNC) < 0) {
+        __atomic_store_n(&dirty, 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&sync_failed, 1, __ATOMIC_RELEASE);
+        return -REG_ERR_INTERNAL;
+    }
+    return 0;
+}
+
+static int image_valid(const image_t *img)
+{
+    return img->header.magic == IMAGE_MAGIC
+        && img->header.version == IMAGE_VERSION
+        && img->header.slot_size == sizeof(regval_t)
+        && img->header.slots == IMAGE_SLOTS
+        && img->header.map_hash == register_map_hash();
+}
+
+/**
+ * Called after each save, msync the image if the sync interval
+ * has passed since the last one. Of the saves which find it due at
+ * once, the one which moves last_sync_ms on does the msync. The save
+ * is done by then whatever the msync gives, see regstore_mmap_sync().
+ */
+static void sync_if_due(void)
+{
+    uint64_t now, last;
+
+    __atomic_store_n(&dirty, 1, __ATOMIC_RELEASE);
+    if (sync_interval < 0) return;
+    if (sync_interval > 0) {
+        now = clock_ms();
+        last = __atomic_load_n(&last_sync_ms, __ATOMIC_ACQUIRE);
+        if (now - last < (uint64_t)sync_interval
+                || ! __atomic_compare_exchange_n(&last_sync_ms, &last, now,
+                    0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            return;
+    }
+    sync_image();
+}
+
+static int load_register(regval_t *val, mb_ref_t ref)
+{
+    if (! image) return -REG_ERR_INTERNAL;
+    load_slots(val, &ref, 1);
+    return 0;
+}
+
+static int save_register(const regval_t *val, mb_ref_t ref)
+{
+    if (! image) return -REG_ERR_INTERNAL;
+    yam_reg_update_begin(regbank_current());
+    image->slots[ref] = *val;
+    yam_reg_update_end(regbank_current());
+    sync_if_due();
+    return 0;
+}
+
+static int load_registers(regval_t *vals, const mb_ref_t *refs, size_t n)
+{
+    if (! image) return -REG_ERR_INTERNAL;
+    load_slots(vals, refs, n);
+    return 0;
+}
+
+static int save_registers(const regval_t *vals, const mb_ref_t *refs,
+        size_t n)
+{
+    size_t i;
+
+    if (! image) return -REG_ERR_INTERNAL;
+    yam_reg_update_begin(regbank_current());
+    for (i = 0; i < n; ++i)
+        image->slots[refs[i]] = vals[i];
+    yam_reg_update_end(regbank_current());
+    sync_if_due();
+    return 0;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+int regstore_mmap_open(const char *path, int sync_interval_ms)
+{
+    struct stat st;
+    image_t *img;
+    int fd, fresh;
+
+    if (image) return -1;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) return -1;
+    if (fstat(fd, &st) < 0) goto fail;
+    fresh = st.st_size != sizeof(image_t);
+    if (fresh && ftruncate(fd, sizeof(image_t)) < 0) goto fail;
+
+    img = mmap(NULL, sizeof(image_t), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+    if (img == MAP_FAILED) goto fail;
+    close(fd);
+
+    if (fresh || ! image_valid(img)) {
+        memset(img, 0, sizeof(image_t));
+        img->header.magic = IMAGE_MAGIC;
+        img->header.version = IMAGE_VERSION;
+        img->header.slot_size = sizeof(regval_t);
+        img->header.slots = IMAGE_SLOTS;
+        img->header.map_hash = register_map_hash();
+        msync(img, sizeof(image_t), MS_SYNC);
+        fresh = 1;
+    }
+
+    image = img;
+    sync_interval = sync_interval_ms;
+    __atomic_store_n(&dirty, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&sync_failed, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&last_sync_ms, clock_ms(), __ATOMIC_RELEASE);
+    return fresh;
+
+fail:
+    close(fd);
+    return -1;
+}
+
+int regstore_mmap_sync(void)
+{
+    int err;
+
+    if (! image) return -REG_ERR_INTERNAL;
+
+    __atomic_store_n(&last_sync_ms, clock_ms(), __ATOMIC_RELEASE);
+    err = sync_image();
+    if (__atomic_exchange_n(&sync_failed, 0, __ATOMIC_ACQ_REL))
+        err = -REG_ERR_INTERNAL;
+    return err;
+}
+
+void regstore_mmap_close(void)
+{
+    if (! image) return;
+
+    regstore_mmap_sync();
+    munmap(image, sizeof(image_t));
+    image = NULL;
+}
+
+#endif /* YAM_REGSTORE_MMAP */
@@ -0,0 +1,73 @@
+/**
+ * @file regstore_mmap.h
+ * @brief Register store backed by a memory-mapped file
+ *
+ * The register image is kept in a file mapped into memory, one value
+ * slot per ref. Loads and saves are plain memory accesses, the kernel
+ * writes the pages back, and msync() is issued at most once per sync
+ * interval. The image is tagged with register_map_hash(), an image
+ * that doesn't match the .register section is reinitialized, changes
+ * of runtime tables are not detected.
+ *
+ * The interval is only checked by a save, so the saves of the last
+ * interval stay un-msync'ed until the next save after it, a call of
+ * regstore_mmap_sync(), or regstore_mmap_close(), which flushes them.
+ * Until then they are only as durable as the kernel's writeback.
+ *
+ * A save succeeds once its values are in the image, whether the msync
+ * it issues succeeds or not: the values are visible to the readers by
+ * then. A failed msync is reported by the next regstore_mmap_sync().
+ *
+ * Note: this backend needs a POSIX system with mmap(), and is built
+ * with YAM_REGSTORE_MMAP.
+ */
+
+#ifndef __YAM_REGSTORE_MMAP_H
+#define __YAM_REGSTORE_MMAP_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include "register.h"
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Store callbacks of the mmap store, install them with
+ * register_install_store_cb() after regstore_mmap_open().
+ */
+extern const regstore_cb_t regstore_mmap_cb;
+
+/**
+ * Open (or create) the register image file and map it.
+ * @param path path of the image file.
+ * @param sync_interval_ms minimal interval between two msync() calls
+ *      issued by saves: zero to msync on every save, negative to never
+ *      msync from saves, leaving it to the kernel and regstore_mmap_sync().
+ * @return 0 if an existing image was mapped, 1 if a new image was
+ *         initialized, or negative if error.
+ */
+int regstore_mmap_open(const char *path, int sync_interval_ms);
+
+/**
+ * Flush the modified pages of the image to the file synchronously.
+ * @return 0 on success, or negative if this msync or one issued by a
+ *         save since the last call failed.
+ */
+int regstore_mmap_sync(void);
+
+/**
+ * Flush and unmap the image.
+ */
+void regstore_mmap_close(void);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* __YAM_REGSTORE_MMAP_H */
@@ -6,14 +6,77 @@
  *      INCLUDES
  *********************/
 #include <stddef.h>
+#include <stdint.h>
+#include <string.h>
 #include "regval.h"
 
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+/* the 16-octet vectors of permute(), vec_from and vec_to move the lanes
+ * from and to words */
+#if defined(__SSSE3__)
+#define PERM_VECTOR     1
+#define vec_load(p)             _mm_loadu_si128((const __m128i *)(p))
+#define vec_store(p, v)         _mm_storeu_si128((__m128i *)(p), v)
+#define vec_shuffle(v, m)       _mm_shuffle_epi8(v, m)
+#define vec_from32(a, b, c, d)  _mm_setr_epi32(a, b, c, d)
+#define vec_from64(a, b)        _mm_set_epi64x(b, a)
+#define vec_to32(v, w) do { \
+    (w)[0] = _mm_cvtsi128_si32(v); \
+    (w)[1] = _mm_cvtsi128_si32(_mm_srli_si128(v, 4)); \
+    (w)[2] = _mm_cvtsi128_si32(_mm_srli_si128(v, 8)); \
+    (w)[3] = _mm_cvtsi128_si32(_mm_srli_si128(v, 12)); \
+    } while (0)
+#define vec_to64(v, d) do { \
+    _mm_storel_epi64((__m128i *)(d), v); \
+    _mm_storel_epi64((__m128i *)((d) + 1), _mm_unpackhi_epi64(v, v)); \
+    } while (0)
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#define PERM_VECTOR     1
+#define vec_load(p)             vld1q_u8(p)
+#define vec_store(p, v)         vst1q_u8(p, v)
+#define vec_shuffle(v, m)       vqtbl1q_u8(v, m)
+#define vec_from32(a, b, c, d) \
+    vreinterpretq_u8_u32((uint32x4_t){ a, b, c, d })
+#define vec_from64(a, b)        vreinterpretq_u8_u64((uint64x2_t){ a, b })
+#define vec_to32(v, w)          vst1q_u32(w, vreinterpretq_u32_u8(v))
+#define vec_to64(v, d)          vst1q_u64(d, vreinterpretq_u64_u8(v))
+#else
+#define PERM_VECTOR     0
+#endif
+
+#define codec_valid(codec) ((codec) >= 0 && (codec) < REGVAL_CODEC_NUM \
+        && val_codec_spec_table[codec].reg_size)
+
+/* shuffles of the elements of a 16-octet vector, see shuffle_t */
+#define SHUF2X8(a, b) \
+    {{ a, b, a + 2, b + 2, a + 4, b + 4, a + 6, b + 6, \
+       a + 8, b + 8, a + 10, b + 10, a + 12, b + 12, a + 14, b + 14 }}
+#define SHUF4X4(a, b, c, d) \
+    {{ a, b, c, d, a + 4, b + 4, c + 4, d + 4, \
+       a + 8, b + 8, c + 8, d + 8, a + 12, b + 12, c + 12, d + 12 }}
+#define SHUF8X2(a, b, c, d, e, f, g, h) \
+    {{ a, b, c, d, e, f, g, h, \
+       a + 8, b + 8, c + 8, d + 8, e + 8, f + 8, g + 8, h + 8 }}
+
 /**********************
  *      TYPEDEFS
  **********************/
-typedef void (* regval_encoder_t)(const regval_t *val, short mb_scale, char *buf);
-typedef void (* regval_decoder_t)(const char *buf, regval_t *val, short mb_scale);
-
+/* fmt is the octet order of values of two or four registers, see
+ * order_fmt() */
+typedef void (* regval_encoder_t)(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf);
+typedef void (* regval_decoder_t)(const char *buf, regval_t *val,
+        short mb_scale, const short *fmt);
+
+/* the one-register codecs have no octet order, they're called directly */
 typedef struct {
     char tag;
     char reg_size;
@@ -21,112 +84,273 @@ typedef struct {
     regval_decoder_t decoder;
 } val_codec_spec_t;
 
+/**
+ * Octet shuffle of permute(), octet k of an output element is octet
+ * m[k] of the input element. A 16-octet vector holds 16 / size elements
+ * packed, the next ones follow in m, so the vector paths take m as their
+ * mask as it is.
+ */
+typedef struct {
+    unsigned char m[16];
+} shuffle_t;
+
+#if defined(__SSSE3__)
+typedef __m128i vec_t;
+#elif PERM_VECTOR
+typedef uint8x16_t vec_t;
+#endif
+
+/* layouts of the shuffles of an order, see order_shuffles */
+enum {
+    SHUF_32,                    /* four-octet values, four at a time */
+    SHUF_64,                    /* eight-octet values, two at a time */
+    SHUF_NUM,
+};
+
 /**********************
  *   STATIC PROTOTYPES
  **********************/
-static void integer_to_mb_short(const regval_t *val, short mb_scale, char *buf);
-static void mb_short_to_integer(const char *buf, regval_t *val, short mb_scale);
-static void integer_to_mb_long(const regval_t *val, short mb_scale, char *buf);
-static void mb_long_to_integer(const char *buf, regval_t *val, short mb_scale);
-static void float_to_mb_short(const regval_t *val, short mb_scale, char *buf);
-static void mb_short_to_float(const char *buf, regval_t *val, short mb_scale);
-static void float_to_mb_float(const regval_t *val, short mb_scale, char *buf);
-static void mb_float_to_float(const char *buf, regval_t *val, short mb_scale);
+static void integer_to_mb_short(const regval_t *val, short mb_scale,
+        char *buf);
+static void mb_short_to_integer(const char *buf, regval_t *val,
+        short mb_scale);
+static void integer_to_mb_long(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf);
+static void mb_long_to_integer(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt);
+static void float_to_mb_short(const regval_t *val, short mb_scale,
+        char *buf);
+static void mb_short_to_float(const char *buf, regval_t *val,
+        short mb_scale);
+static void float_to_mb_float(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf);
+static void mb_float_to_float(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt);
+#if YAM_REG_64BIT
+static void int64_to_mb(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf);
+static void mb_to_int64(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt);
+static void uint64_to_mb(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf);
+static void mb_to_uint64(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt);
+#endif
+#if YAM_REG_DOUBLE
+static void double_to_mb(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf);
+static void mb_to_double(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt);
+#endif
 
 /**********************
  *   STATIC VARIABLES
  **********************/
-static const val_codec_spec_t val_codec_spec_table[] = {
-    {
-        .tag = _integer, 
+/* a codec left out has no reg_size, see codec_valid() */
+static const val_codec_spec_t val_codec_spec_table[REGVAL_CODEC_NUM] = {
+    [REGVAL_CODEC_INT16] = {
+        .tag = _integer,
         .reg_size = 1,
-        .encoder = integer_to_mb_short,
-        .decoder = mb_short_to_integer,
     },
-    {
-        .tag = _integer, 
+    [REGVAL_CODEC_INT32] = {
+        .tag = _integer,
         .reg_size = 2,
         .encoder = integer_to_mb_long,
         .decoder = mb_long_to_integer,
     },
-    {
-        .tag = _float, 
+    [REGVAL_CODEC_FLOAT16] = {
+        .tag = _float,
         .reg_size = 1,
-        .encoder = float_to_mb_short,
-        .decoder = mb_short_to_float,
     },
-    {
-        .tag = _float, 
+    [REGVAL_CODEC_FLOAT32] = {
+        .tag = _float,
         .reg_size = 2,
         .encoder = float_to_mb_float,
         .decoder  = mb_float_to_float,
     },
+#if YAM_REG_64BIT
+    [REGVAL_CODEC_INT64] = {
+        .tag = _int64,
+        .reg_size = 4,
+        .encoder = int64_to_mb,
+        .decoder = mb_to_int64,
+    },
+    [REGVAL_CODEC_UINT64] = {
+        .tag = _uint64,
+        .reg_size = 4,
+        .encoder = uint64_to_mb,
+        .decoder = mb_to_uint64,
+    },
+#endif
+#if YAM_REG_DOUBLE
+    [REGVAL_CODEC_DOUBLE] = {
+        .tag = _double,
+        .reg_size = 4,
+        .encoder = double_to_mb,
+        .decoder = mb_to_double,
+    },
+#endif
+};
+
+/* offsets in a host value of the octets in modbus order */
+static const short order_fmts[REGVAL_ORDER_NUM][4] = {
+    [REGVAL_ORDER_B] = {3, 2, 1, 0},
+    [REGVAL_ORDER_BB] = {2, 3, 0, 1},
+    [REGVAL_ORDER_L] = {0, 1, 2, 3},
+    [REGVAL_ORDER_LB] = {1, 0, 3, 2},
 };
 
-static const short float_fmt_b[] = {3, 2, 1, 0};
-static const short *float_fmt = float_fmt_b;
+#if YAM_REG_64BIT
+static const short order_fmts64[REGVAL_ORDER_NUM][8] = {
+    [REGVAL_ORDER_B] = {7, 6, 5, 4, 3, 2, 1, 0},
+    [REGVAL_ORDER_BB] = {6, 7, 4, 5, 2, 3, 0, 1},
+    [REGVAL_ORDER_L] = {0, 1, 2, 3, 4, 5, 6, 7},
+    [REGVAL_ORDER_LB] = {1, 0, 3, 2, 5, 4, 7, 6},
+};
+#endif
+
+/* the order of the global float format */
+static int float_fmt_order = REGVAL_ORDER_B;
+
+/* the shuffles of each order, all of them undo themselves so they
+ * serve encoding and decoding alike
+ */
+static const shuffle_t order_shuffles[REGVAL_ORDER_NUM][SHUF_NUM] = {
+    [REGVAL_ORDER_B] = {
+        SHUF4X4(3, 2, 1, 0),
+        SHUF8X2(7, 6, 5, 4, 3, 2, 1, 0),
+    },
+    [REGVAL_ORDER_BB] = {
+        SHUF4X4(2, 3, 0, 1),
+        SHUF8X2(6, 7, 4, 5, 2, 3, 0, 1),
+    },
+    [REGVAL_ORDER_L] = {
+        SHUF4X4(0, 1, 2, 3),
+        SHUF8X2(0, 1, 2, 3, 4, 5, 6, 7),
+    },
+    [REGVAL_ORDER_LB] = {
+        SHUF4X4(1, 0, 3, 2),
+        SHUF8X2(1, 0, 3, 2, 5, 4, 7, 6),
+    },
+};
+
+/* octets of a host word in modbus order, and back into a regval */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+static const shuffle_t shuffle_raw16 = SHUF2X8(0, 1);
+static const shuffle_t shuffle_be32 = SHUF4X4(0, 1, 2, 3);
+#else
+static const shuffle_t shuffle_raw16 = SHUF2X8(1, 0);
+static const shuffle_t shuffle_be32 = SHUF4X4(3, 2, 1, 0);
+#endif
+
+/* 10^0 to 10^16, mb_scale is -16 to 15 */
+static const float pow10_f[] = {
+    1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f,
+    1e9f, 1e10f, 1e11f, 1e12f, 1e13f, 1e14f, 1e15f, 1e16f,
+};
+
+#if YAM_REG_FIXED_POINT_SCALING || YAM_REG_64BIT
+static const int64_t pow10_i[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+    100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+    1000000000000LL, 10000000000000LL, 100000000000000LL,
+    1000000000000000LL, 10000000000000000LL,
+};
+#endif
+
+#if ! YAM_REG_FIXED_POINT_SCALING || YAM_REG_DOUBLE
+static const double pow10_d[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+    1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+};
+#endif
 
 /**********************
  *   STATIC FUNCTIONS
  **********************/
+/**
+ * Round to the nearest integer, halves away from zero, saturated to
+ * the range of int32_t.
+ */
+static int32_t round_sat(double d)
+{
+    if (d != d) return 0;
+    if (d >= INT32_MAX) return INT32_MAX;
+    if (d <= INT32_MIN) return INT32_MIN;
+    return d < 0 ? (int32_t)(d - 0.5) : (int32_t)(d + 0.5);
+}
+
+/**
+ * Saturate a value to what one register holds: the negative ones are
+ * written as int16, the others as uint16.
+ */
+static inline int32_t reg16_sat(int32_t n)
+{
+    return n < INT16_MIN ? INT16_MIN : n > UINT16_MAX ? UINT16_MAX : n;
+}
+
 /**
  * raw = val * 10^scale, this function calculates the 'val'
  * from 'raw' and 'scale'.
  */
 static float float_prescale(float raw, short scale)
 {
-    if (scale < 0)
-        while (scale) {
-            raw *= 10;
-            scale++;
-        }
-    else if (scale > 0)
-        while (scale) {
-            raw /= 10;
-            scale--;
-        }
-    return raw;
+    return scale > 0 ? raw / pow10_f[scale] : raw * pow10_f[-scale];
 }
 
+#if YAM_REG_FIXED_POINT_SCALING
+/**
+ * val * 10^scale in integer arithmetic only, rounded and saturated as
+ * round_sat() does.
+ */
+static int32_t fixed_scale(int32_t val, short scale)
+{
+    int64_t p, q, r;
+
+    if (scale >= 0) {
+        /* any nonzero int32 times 10^10 is out of range */
+        if (scale > 9) return val > 0 ? INT32_MAX : val < 0 ? INT32_MIN : 0;
+        q = val * pow10_i[scale];
+        return q > INT32_MAX ? INT32_MAX : q < INT32_MIN ? INT32_MIN : q;
+    }
+
+    p = pow10_i[-scale];
+    q = val / p;
+    r = val % p;
+    if (2 * (r < 0 ? -r : r) >= p) q += val < 0 ? -1 : 1;
+    return q;
+}
+
+static int32_t integer_prescale(int32_t raw, short scale)
+{
+    return fixed_scale(raw, -scale);
+}
+
+static int32_t integer_scale(int32_t val, short scale)
+{
+    return fixed_scale(val, scale);
+}
+#else
 /**
  * raw = val * 10^scale, this function calculates the 'val'
  * from 'raw' and 'scale'.
  */
-static float integer_prescale(int32_t raw, short scale)
+static int32_t integer_prescale(int32_t raw, short scale)
 {
-    float f = raw;
-    if (scale < 0)
-        while (scale) {
-            f *= 10;
-            scale++;
-        }
-    else if (scale > 0)
-        while (scale) {
-            f /= 10;
-            scale--;
-        }
-    return f;
+    if (! scale) return raw;
+    return round_sat(scale > 0 ? raw / pow10_d[scale] : raw * pow10_d[-scale]);
 }
 
 /**
  * raw = val * 10^(scale), this function calculates the 'raw'
  * from 'val' and 'scale'.
  */
-static float integer_scale(int32_t val, short scale)
+static int32_t integer_scale(int32_t val, short scale)
 {
-    float f = val;
-    if (scale > 0)
-        while (scale) {
-            f *= 10;
-            scale--;
-        }
-    else if (scale < 0)
-        while (scale) {
-            f /= 10;
-            scale++;
-        }
-    return f;
+    if (! scale) return val;
+    return round_sat(scale > 0 ? val * pow10_d[scale] : val / pow10_d[-scale]);
 }
+#endif
 
 /**
  * raw = val * 10^(scale), this function calculates the 'raw'
@@ -134,142 +358,490 @@ static float integer_scale(int32_t val, short scale)
  */
 static float float_scale(float val, short scale)
 {
+    return scale > 0 ? val * pow10_f[scale] : val / pow10_f[-scale];
+}
+
+#if YAM_REG_64BIT
+/**
+ * val * 10^scale of 64-bit integers, in integer arithmetic as doubles
+ * don't hold them, rounded halves away from zero and saturated.
+ */
+static int64_t int64_scale(int64_t val, short scale)
+{
+    int64_t p, q, r;
+
+    if (! scale) return val;
+    if (scale > 0) {
+        if (__builtin_mul_overflow(val, pow10_i[scale], &q))
+            return val > 0 ? INT64_MAX : INT64_MIN;
+        return q;
+    }
+
+    p = pow10_i[-scale];
+    q = val / p;
+    r = val % p;
+    if (2 * (r < 0 ? -r : r) >= p) q += val < 0 ? -1 : 1;
+    return q;
+}
+
+static uint64_t uint64_scale(uint64_t val, short scale)
+{
+    uint64_t p, q;
+
+    if (! scale) return val;
     if (scale > 0)
-        while (scale) {
-            val *= 10;
-            scale--;
+        return __builtin_mul_overflow(val, (uint64_t)pow10_i[scale], &q)
+            ? UINT64_MAX : q;
+
+    p = pow10_i[-scale];
+    q = val / p;
+    return val % p >= p - val % p ? q + 1 : q;
+}
+#endif
+
+#if YAM_REG_DOUBLE
+static double double_scale(double val, short scale)
+{
+    return scale > 0 ? val * pow10_d[scale] : val / pow10_d[-scale];
+}
+#endif
+
+/**
+ * Resolve the order of a codec, the global float format is read once
+ * per call, so it may be changed while values are converted. Floats
+ * and doubles follow it by default, integers are big-endian.
+ */
+static inline int codec_order(int codec, int order)
+{
+    if (order > REGVAL_ORDER_DEFAULT && order < REGVAL_ORDER_NUM)
+        return order;
+    if (codec == REGVAL_CODEC_FLOAT32 || codec == REGVAL_CODEC_DOUBLE)
+        return __atomic_load_n(&float_fmt_order, __ATOMIC_ACQUIRE);
+    return REGVAL_ORDER_B;
+}
+
+/**
+ * Resolve the octet order of a codec of two or four registers.
+ * @return offsets of reg_size * 2 octets
+ */
+static inline const short *order_fmt(int codec, int order)
+{
+    order = codec_order(codec, order);
+#if YAM_REG_64BIT
+    if (val_codec_spec_table[codec].reg_size == 4) return order_fmts64[order];
+#endif
+    return order_fmts[order];
+}
+
+/**
+ * Move n elements of size octets as a shuffle tells, in_size and
+ * out_size are the strides of the elements, the octets of a stride past
+ * size are left as they are. A stride longer than size is a regval_t,
+ * with the value at its start: the vector paths gather 16 / size of
+ * them into a vector, or scatter a vector over them, as a regval_t
+ * alone would fill a vector with a single value.
+ */
+static void permute(const void *in, size_t in_size, void *out,
+        size_t out_size, size_t size, const shuffle_t *shuf, size_t n)
+{
+    const unsigned char *src = in, *perm = shuf->m;
+    unsigned char *dst = out;
+    size_t i = 0, k;
+
+#if PERM_VECTOR
+    size_t g = 16 / size;
+    vec_t v, m = vec_load(perm);
+    uint32_t w[4];
+    uint64_t d[2];
+
+    for (; i + g <= n; i += g) {
+        const unsigned char *s = src + i * in_size;
+        unsigned char *t = dst + i * out_size;
+
+        if (in_size == size) v = vec_load(s);
+        else if (size == 4) {
+            memcpy(&w[0], s, 4);
+            memcpy(&w[1], s + in_size, 4);
+            memcpy(&w[2], s + 2 * in_size, 4);
+            memcpy(&w[3], s + 3 * in_size, 4);
+            v = vec_from32(w[0], w[1], w[2], w[3]);
+        } else {
+            memcpy(&d[0], s, 8);
+            memcpy(&d[1], s + in_size, 8);
+            v = vec_from64(d[0], d[1]);
         }
-    else if (scale < 0)
-        while (scale) {
-            val /= 10;
-            scale++;
+        v = vec_shuffle(v, m);
+
+        if (out_size == size) {
+            vec_store(t, v);
+            continue;
+        }
+        if (size == 4) {
+            vec_to32(v, w);
+            memcpy(t, &w[0], 4);
+            memcpy(t + out_size, &w[1], 4);
+            memcpy(t + 2 * out_size, &w[2], 4);
+            memcpy(t + 3 * out_size, &w[3], 4);
+        } else {
+            vec_to64(v, d);
+            memcpy(t, &d[0], 8);
+            memcpy(t + out_size, &d[1], 8);
         }
-    return val;
+    }
+#endif
+
+    for (; i < n; ++i)
+        for (k = 0; k < size; ++k)
+            dst[i * out_size + k] = src[i * in_size + perm[k]];
 }
 
-static void integer_to_mb_short(const regval_t *val, short mb_scale, char *buf)
+static void integer_to_mb_short(const regval_t *val, short mb_scale,
+        char *buf)
 {
-    int32_t n = integer_prescale(val->n, mb_scale);
+    int32_t n = reg16_sat(integer_prescale(val->n, mb_scale));
     buf[0] = n >> 8;
     buf[1] = n;
 }
 
-static void mb_short_to_integer(const char *buf, regval_t *val, short mb_scale)
+/**
+ * A word is read as an int16, so a negative value written comes back,
+ * whatever the signedness of char.
+ */
+static void mb_short_to_integer(const char *buf, regval_t *val,
+        short mb_scale)
 {
-    int32_t n = buf[0] * 256 + buf[1];
+    const unsigned char *p = (const unsigned char *)buf;
+    int32_t n = (int16_t)(p[0] << 8 | p[1]);
     n = integer_scale(n, mb_scale);
     regval_put_integer(val, n);
 }
 
-static void float_to_mb_short(const regval_t *val, short mb_scale, char *buf)
+static void float_to_mb_short(const regval_t *val, short mb_scale,
+        char *buf)
 {
-    float f = float_prescale(val->f, mb_scale);
-    buf[0] = (int)f >> 8;
-    buf[1] = (int)f;
+    int32_t n = reg16_sat(round_sat(float_prescale(val->f, mb_scale)));
+    buf[0] = n >> 8;
+    buf[1] = n;
 }
 
-static void mb_short_to_float(const char *buf, regval_t *val, short mb_scale)
+static void mb_short_to_float(const char *buf, regval_t *val,
+        short mb_scale)
 {
-    int32_t n = buf[0] * 256 + buf[1];
-    float f = integer_scale(n, mb_scale);
+    const unsigned char *p = (const unsigned char *)buf;
+    int32_t n = (int16_t)(p[0] << 8 | p[1]);
+    float f = float_scale(n, mb_scale);
     regval_put_float(val, f);
 }
 
-static void integer_to_mb_long(const regval_t *val, short mb_scale, char *buf)
+static void integer_to_mb_long(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf)
 {
     int32_t n = integer_prescale(val->n, mb_scale);
     const char *p = (const char*) &n;
 
-    buf[0] = *(p + 3);
-    buf[1] = *(p + 2);
-    buf[2] = *(p + 1);
-    buf[3] = *p;
+    buf[0] = *(p + fmt[0]);
+    buf[1] = *(p + fmt[1]);
+    buf[2] = *(p + fmt[2]);
+    buf[3] = *(p + fmt[3]);
 }
 
-static void mb_long_to_integer(const char *buf, regval_t *val, short mb_scale)
+static void mb_long_to_integer(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt)
 {
     int n;
     uint8_t *p = (uint8_t*)&n;
 
-    *(p + 3) = buf[0];
-    *(p + 2) = buf[1];
-    *(p + 1) = buf[2];
-    *(p + 0) = buf[3];
+    *(p + fmt[0]) = buf[0];
+    *(p + fmt[1]) = buf[1];
+    *(p + fmt[2]) = buf[2];
+    *(p + fmt[3]) = buf[3];
 
     n = integer_scale(n, mb_scale);
     regval_put_integer(val, n);
 }
 
-static void float_to_mb_float(const regval_t *val, short mb_scale, char *buf)
+static void float_to_mb_float(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf)
 {
     float f = float_prescale(val->f, mb_scale);
     const char *p = (const char*) &f;
 
-    buf[0] = *(p + float_fmt[0]);
-    buf[1] = *(p + float_fmt[1]);
-    buf[2] = *(p + float_fmt[2]);
-    buf[3] = *(p + float_fmt[3]);
+    buf[0] = *(p + fmt[0]);
+    buf[1] = *(p + fmt[1]);
+    buf[2] = *(p + fmt[2]);
+    buf[3] = *(p + fmt[3]);
 }
 
-static void mb_float_to_float(const char *buf, regval_t *val, short mb_scale)
+static void mb_float_to_float(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt)
 {
     float f;
     uint8_t *p = (uint8_t*)&f;
 
-    /* FB B format, other formats will be suported late */
-    *(p + float_fmt[0]) = buf[0];
-    *(p + float_fmt[1]) = buf[1];
-    *(p + float_fmt[2]) = buf[2];
-    *(p + float_fmt[3]) = buf[3];
+    *(p + fmt[0]) = buf[0];
+    *(p + fmt[1]) = buf[1];
+    *(p + fmt[2]) = buf[2];
+    *(p + fmt[3]) = buf[3];
 
     f = float_scale(f, mb_scale);
     regval_put_float(val, f);
 }
 
+#if YAM_REG_64BIT
+static void int64_to_mb(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf)
+{
+    int64_t n = int64_scale(val->n64, -mb_scale);
+    const char *p = (const char*) &n;
+    int k;
+
+    for (k = 0; k < 8; ++k) buf[k] = *(p + fmt[k]);
+}
+
+static void mb_to_int64(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt)
+{
+    int64_t n;
+    uint8_t *p = (uint8_t*)&n;
+    int k;
+
+    for (k = 0; k < 8; ++k) *(p + fmt[k]) = buf[k];
+    regval_put_int64(val, int64_scale(n, mb_scale));
+}
+
+static void uint64_to_mb(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf)
+{
+    uint64_t n = uint64_scale(val->u64, -mb_scale);
+    const char *p = (const char*) &n;
+    int k;
+
+    for (k = 0; k < 8; ++k) buf[k] = *(p + fmt[k]);
+}
+
+static void mb_to_uint64(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt)
+{
+    uint64_t n;
+    uint8_t *p = (uint8_t*)&n;
+    int k;
+
+    for (k = 0; k < 8; ++k) *(p + fmt[k]) = buf[k];
+    regval_put_uint64(val, uint64_scale(n, mb_scale));
+}
+#endif
+
+#if YAM_REG_DOUBLE
+static void double_to_mb(const regval_t *val, short mb_scale,
+        const short *fmt, char *buf)
+{
+    double d = double_scale(val->d, -mb_scale);
+    const char *p = (const char*) &d;
+    int k;
+
+    for (k = 0; k < 8; ++k) buf[k] = *(p + fmt[k]);
+}
+
+static void mb_to_double(const char *buf, regval_t *val, short mb_scale,
+        const short *fmt)
+{
+    double d;
+    uint8_t *p = (uint8_t*)&d;
+    int k;
+
+    for (k = 0; k < 8; ++k) *(p + fmt[k]) = buf[k];
+    regval_put_double(val, double_scale(d, mb_scale));
+}
+#endif
+
+static inline void encode_val(int codec, const regval_t *val,
+        short mb_scale, const short *fmt, char *buf)
+{
+    if (codec == REGVAL_CODEC_INT16)
+        integer_to_mb_short(val, mb_scale, buf);
+    else if (codec == REGVAL_CODEC_FLOAT16)
+        float_to_mb_short(val, mb_scale, buf);
+    else val_codec_spec_table[codec].encoder(val, mb_scale, fmt, buf);
+}
+
+static inline void decode_val(int codec, const char *buf, regval_t *val,
+        short mb_scale, const short *fmt)
+{
+    if (codec == REGVAL_CODEC_INT16)
+        mb_short_to_integer(buf, val, mb_scale);
+    else if (codec == REGVAL_CODEC_FLOAT16)
+        mb_short_to_float(buf, val, mb_scale);
+    else val_codec_spec_table[codec].decoder(buf, val, mb_scale, fmt);
+}
+
 /**********************
  *   GLOBAL FUNCTIONS
  **********************/
-int regval_encode_mb(const regval_t *val, char *buf,
-        type_tag_t tag, mb_size_t mb_size, scale_t mb_scale)
+int regval_codec_id(type_tag_t tag, mb_size_t mb_size)
 {
-    size_t i;
+    int i;
 
-    for (i = 0;
-            i < sizeof(val_codec_spec_table) / sizeof(val_codec_spec_t)
-            && (tag != val_codec_spec_table[i].tag
-                || mb_size != val_codec_spec_table[i].reg_size);
-            ++i);
-    if (i == sizeof(val_codec_spec_table) / sizeof(val_codec_spec_t)) return -1;
-    if (! val_codec_spec_table[i].encoder) return -1;
+    for (i = 0; i < REGVAL_CODEC_NUM; ++i)
+        if (tag == val_codec_spec_table[i].tag
+                && mb_size == val_codec_spec_table[i].reg_size)
+            return i;
+    return -1;
+}
 
-    val_codec_spec_table[i].encoder(val, mb_scale, buf);
+int regval_encode_mb_codec(int codec, int order, const regval_t *val,
+        char *buf, scale_t mb_scale)
+{
+    /* the most common one is called directly */
+    if (codec == REGVAL_CODEC_INT16) {
+        integer_to_mb_short(val, mb_scale, buf);
+        return 0;
+    }
+    if (! codec_valid(codec)) return -1;
+
+    encode_val(codec, val, mb_scale, order_fmt(codec, order), buf);
     return 0;
 }
 
-int regval_decode_mb(const char *buf, regval_t *val,
-        type_tag_t tag, mb_size_t mb_size, scale_t mb_scale)
+int regval_decode_mb_codec(int codec, int order, const char *buf,
+        regval_t *val, scale_t mb_scale)
 {
-    size_t i;
+    if (codec == REGVAL_CODEC_INT16) {
+        mb_short_to_integer(buf, val, mb_scale);
+        return 0;
+    }
+    if (! codec_valid(codec)) return -1;
 
-    for (i = 0;
-            i < sizeof(val_codec_spec_table) / sizeof(val_codec_spec_t)
-            && (tag != val_codec_spec_table[i].tag
-                || mb_size != val_codec_spec_table[i].reg_size);
-            ++i);
-    if (i == sizeof(val_codec_spec_table) / sizeof(val_codec_spec_t)) return -1;
-    if (! val_codec_spec_table[i].decoder) return -1;
+    decode_val(codec, buf, val, mb_scale, order_fmt(codec, order));
+    return 0;
+}
 
-    val_codec_spec_table[i].decoder(buf, val, mb_scale);
+int regval_encode_mb_bulk(int codec, int order, const regval_t *vals,
+        size_t n, char *buf, scale_t mb_scale)
+{
+    const short *f;
+    size_t i;
+    int w;
+
+    if (! codec_valid(codec)) return -1;
+    w = val_codec_spec_table[codec].reg_size * 2;
+
+    if (! mb_scale && w >= 4) {
+        permute(vals, sizeof(regval_t), buf, w, w,
+                &order_shuffles[codec_order(codec, order)]
+                [w == 4 ? SHUF_32 : SHUF_64], n);
+        return 0;
+    }
+
+    f = order_fmt(codec, order);
+    for (i = 0; i < n; ++i) {
+        encode_val(codec, &vals[i], mb_scale, f, buf);
+        buf += w;
+    }
     return 0;
 }
 
+int regval_decode_mb_bulk(int codec, int order, const char *buf,
+        regval_t *vals, size_t n, scale_t mb_scale)
+{
+    const short *f;
+    size_t i;
+    int w;
+
+    if (! codec_valid(codec)) return -1;
+    w = val_codec_spec_table[codec].reg_size * 2;
+
+    if (! mb_scale && w >= 4) {
+        permute(buf, w, vals, sizeof(regval_t), w,
+                &order_shuffles[codec_order(codec, order)]
+                [w == 4 ? SHUF_32 : SHUF_64], n);
+        for (i = 0; i < n; ++i)
+            vals[i].tag = val_codec_spec_table[codec].tag;
+        return 0;
+    }
+
+    f = order_fmt(codec, order);
+    for (i = 0; i < n; ++i) {
+        decode_val(codec, buf, &vals[i], mb_scale, f);
+        buf += w;
+    }
+    return 0;
+}
+
+/* shuffle_raw16 and shuffle_be32 reverse the octets, they undo
+ * themselves, as the shuffles of the float formats do
+ */
+void regval_encode_be16(const uint16_t *src, size_t n, char *buf)
+{
+    permute(src, 2, buf, 2, 2, &shuffle_raw16, n);
+}
+
+void regval_decode_be16(const char *buf, size_t n, uint16_t *dst)
+{
+    permute(buf, 2, dst, 2, 2, &shuffle_raw16, n);
+}
+
+void regval_encode_be32(const uint32_t *src, size_t n, char *buf)
+{
+    permute(src, 4, buf, 4, 4, &shuffle_be32, n);
+}
+
+void regval_decode_be32(const char *buf, size_t n, uint32_t *dst)
+{
+    permute(buf, 4, dst, 4, 4, &shuffle_be32, n);
+}
+
+void regval_encode_float(const float *src, size_t n, char *buf)
+{
+    permute(src, 4, buf, 4, 4, &order_shuffles[__atomic_load_n(
+                &float_fmt_order, __ATOMIC_ACQUIRE)][SHUF_32], n);
+}
+
+void regval_decode_float(const char *buf, size_t n, float *dst)
+{
+    permute(buf, 4, dst, 4, 4, &order_shuffles[__atomic_load_n(
+                &float_fmt_order, __ATOMIC_ACQUIRE)][SHUF_32], n);
+}
+
+int regval_encode_mb(const regval_t *val, char *buf,
+        type_tag_t tag, mb_size_t mb_size, scale_t mb_scale)
+{
+    return regval_encode_mb_codec(regval_codec_id(tag, mb_size),
+            REGVAL_ORDER_DEFAULT, val, buf, mb_scale);
+}
+
+int regval_decode_mb(const char *buf, regval_t *val,
+        type_tag_t tag, mb_size_t mb_size, scale_t mb_scale)
+{
+    return regval_decode_mb_codec(regval_codec_id(tag, mb_size),
+            REGVAL_ORDER_DEFAULT, buf, val, mb_scale);
+}
+
 inline int regval_compare(const regval_t *val, int32_t a)
 {
+    switch (val->tag) {
+#if YAM_REG_64BIT
+    case _int64: return (val->n64 > a) - (val->n64 < a);
+    case _uint64: return a < 0 || val->u64 > (uint64_t)a ? 1
+                  : val->u64 < (uint64_t)a ? -1 : 0;
+#endif
+#if YAM_REG_DOUBLE
+    case _double: return (val->d > a) - (val->d < a);
+#endif
+    }
     return val->tag == _integer ? val->n - a : val->f - a;
 }
 
 inline int regval_compare_f(const regval_t *val, float a)
 {
+    switch (val->tag) {
+#if YAM_REG_64BIT
+    case _int64: return (val->n64 > a) - (val->n64 < a);
+    case _uint64: return (val->u64 > a) - (val->u64 < a);
+#endif
+#if YAM_REG_DOUBLE
+    case _double: return (val->d > a) - (val->d < a);
+#endif
+    }
     return val->tag == _float ? val->f - a : val->n - a;
 }
 
@@ -285,8 +857,36 @@ inline void regval_put_float(regval_t *val, float v)
     val->tag = _float;
 }
 
+#if YAM_REG_64BIT
+inline void regval_put_int64(regval_t *val, int64_t v)
+{
+    val->n64 = v;
+    val->tag = _int64;
+}
+
+inline void regval_put_uint64(regval_t *val, uint64_t v)
+{
+    val->u64 = v;
+    val->tag = _uint64;
+}
+#endif
+
+#if YAM_REG_DOUBLE
+inline void regval_put_double(regval_t *val, double v)
+{
+    val->d = v;
+    val->tag = _double;
+}
+#endif
+
 int regval_set_float_fmt(const short *fmt)
 {
-    float_fmt = fmt;
-    return 0;
+    int i;
+
+    for (i = REGVAL_ORDER_B; i < REGVAL_ORDER_NUM; ++i)
+        if (! memcmp(fmt, order_fmts[i], sizeof(order_fmts[i]))) {
+            __atomic_store_n(&float_fmt_order, i, __ATOMIC_RELEASE);
+            return 0;
+        }
+    return -1;
 }
@@ -8,6 +8,7 @@
 /**********************
  *      INCLUDES
  **********************/
+#include <stddef.h>
 #include <stdint.h>
 #include "../options.h"
 
@@ -25,12 +26,51 @@ typedef int8_t scale_t;
 enum {
     _integer,
     _float,
+    _int64,
+    _uint64,
+    _double,
+};
+
+/**
+ * Codecs of the (tag, size) pairs, see regval_codec_id().
+ */
+enum {
+    REGVAL_CODEC_INT16,         /* _integer in one register */
+    REGVAL_CODEC_INT32,         /* _integer in two registers */
+    REGVAL_CODEC_FLOAT16,       /* _float in one register */
+    REGVAL_CODEC_FLOAT32,       /* _float in two registers */
+    REGVAL_CODEC_INT64,         /* _int64 in four registers, YAM_REG_64BIT */
+    REGVAL_CODEC_UINT64,        /* _uint64 in four registers, YAM_REG_64BIT */
+    REGVAL_CODEC_DOUBLE,        /* _double in four registers, YAM_REG_DOUBLE */
+    REGVAL_CODEC_NUM,
+};
+
+/**
+ * Octet orders of the values spanning two or four registers, named as
+ * in regval_set_float_fmt(), four-register values swap the octets and
+ * the words the same way. With the default order floats and doubles
+ * follow the global float format and integers are big-endian.
+ */
+enum {
+    REGVAL_ORDER_DEFAULT,
+    REGVAL_ORDER_B,             /* 0x12345678 as 12 34 56 78 */
+    REGVAL_ORDER_BB,            /* 0x12345678 as 34 12 78 56 */
+    REGVAL_ORDER_L,             /* 0x12345678 as 78 56 34 12 */
+    REGVAL_ORDER_LB,            /* 0x12345678 as 56 78 12 34 */
+    REGVAL_ORDER_NUM,
 };
 
 typedef struct {
     union {
         int32_t n;
         float f;
+#if YAM_REG_64BIT
+        int64_t n64;
+        uint64_t u64;
+#endif
+#if YAM_REG_DOUBLE
+        double d;
+#endif
     };
     type_tag_t tag;
 } regval_t;
@@ -56,6 +96,31 @@ void regval_put_integer(regval_t *val, int32_t v);
  */
 void regval_put_float(regval_t *val, float v);
 
+#if YAM_REG_64BIT
+/**
+ * Put a 64-bit signed integer value into a regval.
+ * @param val the regval
+ * @param v the integer
+ */
+void regval_put_int64(regval_t *val, int64_t v);
+
+/**
+ * Put a 64-bit unsigned integer value into a regval.
+ * @param val the regval
+ * @param v the integer
+ */
+void regval_put_uint64(regval_t *val, uint64_t v);
+#endif
+
+#if YAM_REG_DOUBLE
+/**
+ * Put a double value into a regval.
+ * @param val the regval
+ * @param v the double
+ */
+void regval_put_double(regval_t *val, double v);
+#endif
+
 /**
  * Compare a regval (a) to an integer (b).
  * @param a the regval
@@ -91,11 +156,59 @@ int regval_encode_mb(const regval_t *val, char *buf,
 int regval_decode_mb(const char *buf, regval_t *val, 
         type_tag_t mb_tag, mb_size_t mb_size, scale_t mb_scale);
 
+/**
+ * Resolve the codec of a (tag, size) pair once, for
+ * regval_encode_mb_codec() and regval_decode_mb_codec().
+ * @return the codec id, or negative if there's no codec for the pair.
+ */
+int regval_codec_id(type_tag_t tag, mb_size_t mb_size);
+
+/**
+ * Encode a regval with a resolved codec, in one of REGVAL_ORDER_*.
+ * See: regval_encode_mb()
+ */
+int regval_encode_mb_codec(int codec, int order, const regval_t *val,
+        char *buf, scale_t mb_scale);
+
+/**
+ * Decode a regval with a resolved codec, in one of REGVAL_ORDER_*.
+ * See: regval_decode_mb()
+ */
+int regval_decode_mb_codec(int codec, int order, const char *buf,
+        regval_t *val, scale_t mb_scale);
+
+/**
+ * Encode n values of a codec and scale into consecutive registers.
+ * Unscaled values, except 16-bit floats, are moved with byte shuffles,
+ * SIMD ones where the target has them.
+ * @return zero on success or negative when fail
+ */
+int regval_encode_mb_bulk(int codec, int order, const regval_t *vals,
+        size_t n, char *buf, scale_t mb_scale);
+
+/**
+ * Decode n values of a codec and scale from consecutive registers.
+ * See: regval_encode_mb_bulk()
+ */
+int regval_decode_mb_bulk(int codec, int order, const char *buf,
+        regval_t *vals, size_t n, scale_t mb_scale);
+
+/**
+ * Convert raw arrays to and from modbus order: big-endian 16 and 32-bit
+ * words, and floats in the format set by regval_set_float_fmt().
+ */
+void regval_encode_be16(const uint16_t *src, size_t n, char *buf);
+void regval_decode_be16(const char *buf, size_t n, uint16_t *dst);
+void regval_encode_be32(const uint32_t *src, size_t n, char *buf);
+void regval_decode_be32(const char *buf, size_t n, uint32_t *dst);
+void regval_encode_float(const float *src, size_t n, char *buf);
+void regval_decode_float(const char *buf, size_t n, float *dst);
+
 /**
  * Set float codec format used for Modbus representation.
  *
  * @param fmt a four-tuple of integers.
- * @return zero on success, negative if error.
+ * @return zero on success, negative if fmt is none of the formats.
  *
  * All the possible formats:
  * b:   {3, 2, 1, 0}
@@ -12,6 +12,7 @@
 #include "appl.h"
 #include "err.h"
 #include "serial_link.h"
+#include "trace.h"
 #include "string.h"
 
 /*********************
@@ -51,7 +52,7 @@ struct yam_slink {
 
     char in_frame[MODBUS_SERIAL_APDU_LEN_MAX];
     size_t in_frame_len;
-    int slave_id;
+    uint32_t slave_ids[256 / 32];   /* bitmap of the served unit IDs */
     char out_frame[MODBUS_SERIAL_APDU_LEN_MAX];
 
     yam_send_frame_cb_t send_frame_cb;
@@ -59,6 +60,12 @@ struct yam_slink {
     serial_link_stats_t stats;
 };
 
+/**********************
+ *      MACROS
+ **********************/
+#define slave_id_served(link, id) \
+    ((link)->slave_ids[(uint8_t)(id) / 32] & (1u << ((uint8_t)(id) % 32)))
+
 /**********************
  *   STATIC FUNCTIONS
  **********************/
@@ -86,13 +93,17 @@ static int yam_slink_process_in_frame(yam_slink_t *link)
         return n;
     link->out_frame[0] = link->in_frame[0];
     ++n;
+    trace_begin(TRACE_CRC_SIGN, 0);
     crc = modbus_crc(link->out_frame, n);
     link->out_frame[n++] = crc;
     link->out_frame[n++] = crc >> 8;
+    trace_end(TRACE_CRC_SIGN, 0);
 
     if (link->send_frame_cb) {
         link->stats.tx_chars += n;
+        trace_begin(TRACE_SEND, 0);
         link->send_frame_cb(link->out_frame, n);
+        trace_end(TRACE_SEND, 0);
     }
     return 0;
 }
@@ -104,7 +115,7 @@ yam_slink_t * yam_create_slink(int slave_id)
 {
     yam_slink_t *link = calloc(1, sizeof(yam_slink_t));
     yam_slink_init(link);
-    link->slave_id = slave_id;
+    yam_set_slink_slave_id(link, slave_id);
     return link;
 }
 
@@ -127,10 +138,12 @@ void yam_slink_putchar(yam_slink_t *link, char c)
 
 int yam_slink_put_frame_delimiter(yam_slink_t *link)
 {
-    int head;
+    int head, err;
     char *p;
     uint16_t crc;
 
+    trace_begin(TRACE_REQUEST, 0);
+    trace_begin(TRACE_RING_DRAIN, 0);
     head = link->recv_buf.head;
     p = link->in_frame;
 
@@ -140,6 +153,7 @@ int yam_slink_put_frame_delimiter(yam_slink_t *link)
     }
 
     link->in_frame_len = p - link->in_frame;
+    trace_end(TRACE_RING_DRAIN, 0);
     
 #ifdef VERBOSE
     log_dump_memory(link->in_frame, link->in_frame_len,
@@ -148,28 +162,47 @@ int yam_slink_put_frame_delimiter(yam_slink_t *link)
 
     if (link->in_frame_len < MODBUS_SERIAL_APDU_LEN_MIN) {
         ++link->stats.bad_frames;
-        return -YAM_ERR_FRAME;
+        err = -YAM_ERR_FRAME;
+        goto out;
     }
-    if (link->in_frame[0] != link->slave_id) {
+    if (! slave_id_served(link, link->in_frame[0])) {
         ll_info("yam: unrecognized slave address %u", link->in_frame[0]);
-        return -YAM_ERR_ADDR;
+        err = -YAM_ERR_ADDR;
+        goto out;
     }
 
+    trace_begin(TRACE_CRC_CHECK, 0);
     crc = modbus_crc(link->in_frame, link->in_frame_len - MODBUS_CRC_SIZE);
+    trace_end(TRACE_CRC_CHECK, 0);
     if ((crc >> 8) != link->in_frame[link->in_frame_len - 1]
             || (crc & 0xff)
             != link->in_frame[link->in_frame_len - MODBUS_CRC_SIZE]
             ) {
         ++link->stats.bad_frames;
-        return -YAM_ERR_FRAME;
+        err = -YAM_ERR_FRAME;
+        goto out;
     }
 
     ++link->stats.good_frames;
 
-    return yam_slink_process_in_frame(link);
+    err = yam_slink_process_in_frame(link);
+out:
+    trace_end(TRACE_REQUEST, 0);
+    return err;
 }
 
 void yam_set_slink_slave_id(yam_slink_t *link, int slave_id)
 {
-    link->slave_id = slave_id;
+    memset(link->slave_ids, 0, sizeof(link->slave_ids));
+    yam_slink_add_slave_id(link, slave_id);
+}
+
+void yam_slink_add_slave_id(yam_slink_t *link, int slave_id)
+{
+    link->slave_ids[(uint8_t)slave_id / 32] |= 1u << ((uint8_t)slave_id % 32);
+}
+
+void yam_slink_remove_slave_id(yam_slink_t *link, int slave_id)
+{
+    link->slave_ids[(uint8_t)slave_id / 32] &= ~(1u << ((uint8_t)slave_id % 32));
 }
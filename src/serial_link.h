@@ -63,13 +63,31 @@ int yam_slink_put_frame_delimiter(yam_slink_t *link);
 void yam_slink_set_send_frame_cb(yam_slink_t *link, yam_send_frame_cb_t cb);
 
 /**
- * Set slave address
+ * Set slave address, it replaces all the slave addresses served
+ * by the link.
  *
  * @param link the link object
  * @param slave_id the slave address associated to the link.
  */
 void yam_set_slink_slave_id(yam_slink_t *link, int slave_id);
 
+/**
+ * Serve one more slave address on the link. Each slave address is
+ * served by the register bank bound to it with yam_app_bind_bank().
+ *
+ * @param link the link object
+ * @param slave_id the slave address to add.
+ */
+void yam_slink_add_slave_id(yam_slink_t *link, int slave_id);
+
+/**
+ * Stop serving a slave address on the link.
+ *
+ * @param link the link object
+ * @param slave_id the slave address to remove.
+ */
+void yam_slink_remove_slave_id(yam_slink_t *link, int slave_id);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
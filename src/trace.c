@@ -0,0 +1,137 @@
+/**
+ * @file trace.c
+ */
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdio.h>
+#include <stdlib.h>
+#include "trace.h"
+
+#if YAM_TRACE
+
+#ifdef __unix__
+#include <time.h>
+#endif
+
+/*********************
+ *      DEFINES
+ *********************/
+#define RING_MASK       (YAM_TRACE_RING_SIZE - 1)
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+/**
+ * Only the owner thread writes a ring, head is published after the
+ * record so a dump sees whole records but the ones being overwritten.
+ * Rings are kept until exit, so they can be dumped after their thread
+ * is gone.
+ */
+typedef struct trace_ring {
+    struct trace_ring *next;
+    uint32_t thread;
+    uint32_t req;
+    uint64_t head;          /* records written */
+    yam_trace_rec_t recs[YAM_TRACE_RING_SIZE];
+} trace_ring_t;
+
+/**********************
+ *  STATIC VARIABLES
+ **********************/
+static YAM_THREAD_LOCAL trace_ring_t *ring;
+static trace_ring_t *rings;
+static uint32_t threads;
+
+/**********************
+ *   STATIC FUNCTIONS
+ **********************/
+static inline uint64_t trace_clock_monotonic(void)
+{
+#ifdef __unix__
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+static trace_ring_t *new_ring(void)
+{
+    trace_ring_t *r = calloc(1, sizeof(trace_ring_t));
+
+    if (! r) return NULL;
+    r->thread = __atomic_fetch_add(&threads, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (! __atomic_compare_exchange_n(&rings, &r->next, r, 1,
+                __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return r;
+}
+
+/**********************
+ *   GLOBAL FUNCTIONS
+ **********************/
+void trace_record(int stage, int phase, uint16_t arg)
+{
+    yam_trace_rec_t *rec;
+    uint64_t head;
+
+    if (! ring && ! (ring = new_ring())) return;
+
+    if (stage == TRACE_REQUEST && phase == TRACE_BEGIN) ++ring->req;
+    head = ring->head;
+    rec = &ring->recs[head & RING_MASK];
+    rec->ts = YAM_TRACE_CLOCK();
+    rec->req = ring->req;
+    rec->stage = stage;
+    rec->phase = phase;
+    rec->arg = arg;
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void yam_trace_reset(void)
+{
+    if (ring) __atomic_store_n(&ring->head, 0, __ATOMIC_RELEASE);
+}
+
+int yam_trace_dump(const char *path)
+{
+    yam_trace_file_t fh = {
+        .magic = YAM_TRACE_MAGIC,
+        .version = YAM_TRACE_VERSION,
+        .rec_size = sizeof(yam_trace_rec_t),
+        .stages = TRACE_STAGES,
+    };
+    yam_trace_ring_t rh;
+    trace_ring_t *r, *first;
+    uint64_t head, i;
+    FILE *f;
+    int err = 0;
+
+    first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+    for (r = first; r; r = r->next) ++fh.rings;
+
+    if (! (f = fopen(path, "wb"))) return -1;
+    if (fwrite(&fh, sizeof(fh), 1, f) != 1) err = -1;
+
+    for (r = first; r && ! err; r = r->next) {
+        head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        rh.thread = r->thread;
+        rh.n = head < YAM_TRACE_RING_SIZE ? head : YAM_TRACE_RING_SIZE;
+        rh.lost = head - rh.n;
+        if (fwrite(&rh, sizeof(rh), 1, f) != 1) err = -1;
+
+        for (i = head - rh.n; i < head && ! err; ++i)
+            if (fwrite(&r->recs[i & RING_MASK], sizeof(yam_trace_rec_t),
+                        1, f) != 1)
+                err = -1;
+    }
+
+    if (fclose(f)) err = -1;
+    return err;
+}
+
+#endif /* YAM_TRACE */
@@ -0,0 +1,134 @@
+/**
+ * @file trace.h
+ * @brief Stage-level request tracing
+ *
+ * The serial link, the application layer and the register layer mark
+ * where each stage of a request begins and ends: ring drain, CRC
+ * check, dispatch, register lookup, store callbacks, encode/decode,
+ * CRC sign and send. Each mark is a timestamped record in a ring of
+ * the calling thread, written without locks, the oldest records are
+ * overwritten once the ring is full.
+ *
+ * yam_trace_dump() saves the rings of all the threads to a binary
+ * file, tools/trace_decode.py turns it into per-stage latency
+ * breakdowns and Chrome trace JSON.
+ *
+ * With YAM_TRACE off the marks compile to nothing. Timestamps are
+ * taken by YAM_TRACE_CLOCK(), CLOCK_MONOTONIC nanoseconds by default;
+ * targets without clock_gettime() have to define it, or get zeros.
+ */
+
+#ifndef __YAM_TRACE_H
+#define __YAM_TRACE_H
+
+/*********************
+ *      INCLUDES
+ *********************/
+#include <stdint.h>
+#include "../options.h"
+
+/*********************
+ *      DEFINES
+ *********************/
+#define YAM_TRACE_MAGIC         0x54524159u     /* "YART" */
+#define YAM_TRACE_VERSION       1
+
+/**********************
+ *      TYPEDEFS
+ **********************/
+/**
+ * The stages, the decoder names them in this order.
+ */
+enum {
+    TRACE_REQUEST,          /* the whole frame, from drain to send, or
+                               a request of yam_app_input_batch() */
+    TRACE_RING_DRAIN,
+    TRACE_CRC_CHECK,
+    TRACE_DISPATCH,         /* arg: function code */
+    TRACE_REG_FIND,         /* range lookups, arg: the first ref */
+    TRACE_STORE,            /* arg: the first ref */
+    TRACE_ENCODE,           /* arg: the first ref */
+    TRACE_DECODE,           /* arg: the first ref */
+    TRACE_CRC_SIGN,
+    TRACE_SEND,
+    TRACE_STAGES,
+};
+
+enum {
+    TRACE_BEGIN,
+    TRACE_END,
+};
+
+/**
+ * A record, as saved by yam_trace_dump().
+ */
+typedef struct {
+    uint64_t ts;            /* ns */
+    uint32_t req;           /* request number in the thread */
+    uint8_t stage;
+    uint8_t phase;          /* TRACE_BEGIN or TRACE_END */
+    uint16_t arg;
+} yam_trace_rec_t;
+
+/**
+ * The dump file is a yam_trace_file_t, then for each thread a
+ * yam_trace_ring_t and its records, the oldest first.
+ */
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t rec_size;
+    uint32_t stages;
+    uint32_t rings;
+} yam_trace_file_t;
+
+typedef struct {
+    uint32_t thread;        /* numbered in the order of the first record */
+    uint32_t n;             /* records that follow */
+    uint64_t lost;          /* overwritten records */
+} yam_trace_ring_t;
+
+/**********************
+ * GLOBAL PROTOTYPES
+ **********************/
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if YAM_TRACE
+/**
+ * Save the rings of all the threads. Threads still tracing may tear
+ * the records being written meanwhile.
+ * @param path the file to write.
+ * @return zero on success, or negative if error.
+ */
+int yam_trace_dump(const char *path);
+
+/**
+ * Empty the ring of the calling thread.
+ */
+void yam_trace_reset(void);
+
+/**
+ * Add a record to the ring of the calling thread, called through
+ * trace_begin() and trace_end().
+ */
+void trace_record(int stage, int phase, uint16_t arg);
+#endif
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+/**********************
+ *      MACROS
+ **********************/
+#if YAM_TRACE
+#define trace_begin(stage, arg) trace_record((stage), TRACE_BEGIN, (arg))
+#define trace_end(stage, arg) trace_record((stage), TRACE_END, (arg))
+#else
+#define trace_begin(stage, arg) do { } while (0)
+#define trace_end(stage, arg) do { } while (0)
+#endif
+
+#endif /* __YAM_TRACE_H */
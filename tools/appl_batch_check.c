@@ -0,0 +1,153 @@
+/**
+ * @file appl_batch_check.c
+ * @brief Check the holding register reads merged by a request batch
+ *
+ * Handles batches of holding register reads (FC3) whose ranges join
+ * up, once over registers of the store only and once over ranges which
+ * hold a register with a read_cb. The responses have to be the ones of
+ * yam_app_input() for each request. The store ones are read with one
+ * store call for the batch, the read_cb is called once per request
+ * which covers its register, as without the batch.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. tools/appl_batch_check.c src/appl.c src/filetype.c \
+ *         src/regbits.c src/register.c src/regindex.c src/regval.c \
+ *         src/regchange.c src/regcache.c src/trace.c -lpthread \
+ *         -o batch_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "yam.h"
+
+#define BATCH       4
+
+static regval_t mem[65536];
+static int store_calls;
+static int cb_calls;
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static int load(regval_t *val, mb_ref_t ref)
+{
+    ++store_calls;
+    regval_put_integer(val, mem[ref].n);
+    return 0;
+}
+
+static int loads(regval_t *vals, const mb_ref_t *refs, size_t n)
+{
+    size_t i;
+
+    ++store_calls;
+    for (i = 0; i < n; ++i) regval_put_integer(&vals[i], mem[refs[i]].n);
+    return 0;
+}
+
+static int save(const regval_t *val, mb_ref_t ref)
+{
+    mem[ref] = *val;
+    return 0;
+}
+
+static const regstore_cb_t store = {
+    .load_register = load,
+    .save_register = save,
+    .load_registers = loads,
+};
+
+/* a counter which moves on each read, as a sensor would */
+static int read_counter(const reg_t *reg, regval_t *val)
+{
+    regval_put_integer(val, ++cb_calls);
+    return 0;
+}
+
+static const reg_t regs[] = {
+    { .ref = 40001, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40002, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40003, .size = 2, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40005, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40006, .size = 1, .tag = _integer, .perm = REG_PERM_RD,
+        .read_cb = read_counter },
+    { .ref = 40007, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+/**
+ * Handle FC3 reads of the ranges one by one, then in a batch with the
+ * counters reset in between, and compare the responses.
+ */
+static void check_batch(const char *what, const uint16_t (*ranges)[2],
+        int n, int want_store_calls, int want_cb_calls)
+{
+    char reqs[BATCH][5], alone[BATCH][MODBUS_PDU_LEN_MAX];
+    char batched[BATCH][MODBUS_PDU_LEN_MAX];
+    int alone_len[BATCH];
+    mb_batch_req_t batch[BATCH];
+    mb_pbuf_t req;
+    int i, ret;
+
+    cb_calls = 0;
+    for (i = 0; i < n; ++i) {
+        reqs[i][0] = MBF_READ_HOLDING_REGS;
+        reqs[i][1] = ranges[i][0] >> 8;
+        reqs[i][2] = ranges[i][0];
+        reqs[i][3] = ranges[i][1] >> 8;
+        reqs[i][4] = ranges[i][1];
+        req.payload = reqs[i];
+        req.len = 5;
+        alone_len[i] = yam_app_input(1, &req, alone[i], MODBUS_PDU_LEN_MAX);
+
+        batch[i].slave_addr = 1;
+        batch[i].req = req;
+        batch[i].resp_buf = batched[i];
+        batch[i].buf_sz = MODBUS_PDU_LEN_MAX;
+    }
+
+    cb_calls = 0;
+    store_calls = 0;
+    ret = yam_app_input_batch(batch, n);
+    check(ret == n, "%s: %d requests handled", what, ret);
+    for (i = 0; i < n; ++i)
+        check(batch[i].resp_len == alone_len[i]
+                && ! memcmp(batched[i], alone[i], alone_len[i]),
+                "%s: request %d answered differently", what, i);
+    check(store_calls == want_store_calls, "%s: %d store calls, expected %d",
+            what, store_calls, want_store_calls);
+    check(cb_calls == want_cb_calls, "%s: %d read_cb calls, expected %d",
+            what, cb_calls, want_cb_calls);
+}
+
+int main(void)
+{
+    static const uint16_t plain[][2] = { {0, 2}, {2, 2}, {1, 3}, {4, 1} };
+    static const uint16_t with_cb[][2] = { {4, 2}, {5, 2}, {2, 4}, {0, 2} };
+    mb_ref_t ref;
+    int ret;
+
+    register_install_store_cb(&store);
+    if ((ret = register_add_table(NULL, regs, sizeof(regs) / sizeof(regs[0])))
+            < 0) {
+        printf("register_add_table: %d\n", ret);
+        return 1;
+    }
+    for (ref = 40001; ref <= 40007; ++ref)
+        regval_put_integer(&mem[ref], ref * 7);
+
+    /* one store call for the batch, none for the requests */
+    check_batch("store only", plain, 4, 1, 0);
+
+    /* the three reads of 40006 call the read_cb three times */
+    check_batch("with read_cb", with_cb, 4, 4, 3);
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,149 @@
+/**
+ * @file appl_fc_check.c
+ * @brief Check the responses of the function code handlers
+ *
+ * Sends request PDUs to yam_app_input() over a small register map and
+ * compares each response with the one expected, octet by octet. The
+ * coils are a table of one-coil registers as long as the longest FC15
+ * write, past the bit store. Build it with -DYAM_REG_BITS=1 as well, a
+ * coil write must not reach the discrete inputs of the bit store.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. tools/appl_fc_check.c src/appl.c src/filetype.c \
+ *         src/regbits.c src/register.c src/regindex.c src/regval.c \
+ *         src/regchange.c src/regcache.c src/trace.c -lpthread \
+ *         -o fc_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "yam.h"
+
+#define COILS           1968    /* the most FC15 writes */
+#define COIL_ADDR       3000
+
+static regval_t mem[65536];
+static reg_t coils[COILS];
+
+static long failures;
+
+static int load(regval_t *val, mb_ref_t ref)
+{
+    regval_put_integer(val, mem[ref].n);
+    return 0;
+}
+
+static int save(const regval_t *val, mb_ref_t ref)
+{
+    mem[ref] = *val;
+    return 0;
+}
+
+static const regstore_cb_t store = {
+    .load_register = load,
+    .save_register = save,
+};
+
+static const reg_t regs[] = {
+    { .ref = 40001, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40002, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+/**
+ * Send a request and compare the response.
+ * @param req the PDU, function code first.
+ * @param want the response expected, NULL with want_len negative for
+ *        an error instead of a response.
+ */
+static void check(const char *what, const char *req, int req_len,
+        const char *want, int want_len)
+{
+    char resp[MODBUS_PDU_LEN_MAX];
+    mb_pbuf_t pbuf = { .payload = (char *)req, .len = req_len };
+    int len, i;
+
+    len = yam_app_input(1, &pbuf, resp, sizeof(resp));
+    if (len == want_len && (len < 0 || ! memcmp(resp, want, len))) return;
+    if (failures++ >= 20) return;
+    printf("%s: %d octets:", what, len);
+    for (i = 0; i < len; ++i) printf(" %02x", (unsigned char)resp[i]);
+    printf(", expected %d\n", want_len);
+}
+
+/**
+ * Write all the coils in one FC15 request. A request which runs one
+ * coil past them writes none.
+ */
+static void check_coils(void)
+{
+    char req[6 + COILS / 8];
+    int i, written = 0;
+
+    req[0] = MBF_WRITE_COILS;
+    req[1] = COIL_ADDR >> 8;
+    req[2] = COIL_ADDR & 0xff;
+    req[3] = COILS >> 8;
+    req[4] = COILS & 0xff;
+    req[5] = COILS / 8;
+    for (i = 0; i < COILS / 8; ++i) req[6 + i] = i * 37 + 1;
+    check("FC15 all coils", req, sizeof(req), req, 5);
+    for (i = 0; i < COILS; ++i)
+        written += mem[COIL_ADDR + 1 + i].n
+            == ((unsigned char)req[6 + i / 8] >> i % 8 & 1);
+    if (written != COILS && failures++ < 20)
+        printf("FC15 all coils: %d coils written\n", written);
+
+    for (i = 0; i < COILS; ++i) regval_put_integer(&mem[COIL_ADDR + 1 + i], 0);
+    req[0] = MBF_WRITE_COILS;
+    req[2] = (COIL_ADDR + 1) & 0xff;
+    check("FC15 past the coils", req, sizeof(req), "\x8f\x02", 2);
+    for (i = 0, written = 0; i < COILS; ++i)
+        written += mem[COIL_ADDR + 1 + i].n != 0;
+    if (written && failures++ < 20)
+        printf("FC15 past the coils: %d coils written\n", written);
+}
+
+int main(void)
+{
+    int i, ret;
+
+    for (i = 0; i < COILS; ++i) {
+        coils[i].ref = COIL_ADDR + COILS_REF_FIRST + i;
+        coils[i].size = 1;
+        coils[i].tag = _integer;
+        coils[i].perm = REG_PERM_RW;
+    }
+    register_install_store_cb(&store);
+    if ((ret = register_add_table(NULL, regs, sizeof(regs) / sizeof(regs[0])))
+            < 0 || (ret = register_add_table(NULL, coils, COILS)) < 0) {
+        printf("register_add_table: %d\n", ret);
+        return 1;
+    }
+    regval_put_integer(&mem[40001], 0x1234);
+    regval_put_integer(&mem[40002], 0x5678);
+
+    check("FC3 40001+2", "\x03\x00\x00\x00\x02", 5,
+            "\x03\x04\x12\x34\x56\x78", 6);
+    check("FC3 40003+1", "\x03\x00\x02\x00\x01", 5, "\x83\x02", 2);
+
+    /* a count of 0 is answered with no data, wherever it starts */
+    check("FC3 40001+0", "\x03\x00\x00\x00\x00", 5, "\x03\x00", 2);
+    check("FC3 40100+0", "\x03\x00\x63\x00\x00", 5, "\x03\x00", 2);
+    check("FC3 0xffff+0", "\x03\xff\xff\x00\x00", 5, "\x03\x00", 2);
+
+    check_coils();
+
+    /* coil 10000 is no discrete input, be it in the bit store or not */
+    check("FC15 10000+1", "\x0f\x27\x10\x00\x01\x01\x01", 7,
+            "\x8f\x02", 2);
+    check("FC5 10000", "\x05\x27\x10\xff\x00", 5, "\x85\x02", 2);
+#if YAM_REG_BITS
+    if (yam_reg_get_bit(DISCRETE_INPUT_REF_FIRST) != 0 && failures++ < 20)
+        printf("discrete input 10001 written by a coil write\n");
+#endif
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
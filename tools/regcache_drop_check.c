@@ -0,0 +1,97 @@
+/**
+ * @file regcache_drop_check.c
+ * @brief Check the cached values dropped by writes
+ *
+ * A register with a read_cb is read through the cache, written, and
+ * read again: the write has to drop the cached value. Then the policy
+ * is cleared, the register written while nothing is cached, and the
+ * policy set again: the value cached before must not come back.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. -DYAM_REG_CACHE=1 tools/regcache_drop_check.c \
+ *         src/register.c src/regindex.c src/regval.c src/regchange.c \
+ *         src/regcache.c src/trace.c -lpthread -o cache_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ */
+
+#include <stdio.h>
+#include "yam.h"
+
+static int sensor = 100;
+static int cb_calls;
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static int read_sensor(const reg_t *reg, regval_t *val)
+{
+    ++cb_calls;
+    regval_put_integer(val, sensor);
+    return 0;
+}
+
+static int write_sensor(const reg_t *reg, const regval_t *val)
+{
+    sensor = val->n;
+    return 0;
+}
+
+static const reg_t regs[] = {
+    { .ref = 40001, .size = 1, .tag = _integer, .perm = REG_PERM_RW,
+        .read_cb = read_sensor, .write_cb = write_sensor,
+        .group = "sensor" },
+};
+
+static void check_read(const char *what, int want, int want_calls)
+{
+    const reg_t *reg;
+    regval_t val;
+
+    cb_calls = 0;
+    val.n = -1;
+    check(register_read(40001, 0, &reg, &val) >= 0 && val.n == want
+            && cb_calls == want_calls, "%s: %d with %d read_cb calls, "
+            "expected %d with %d", what, (int)val.n, cb_calls, want,
+            want_calls);
+}
+
+static void write_value(int v)
+{
+    regval_t val;
+
+    regval_put_integer(&val, v);
+    if (register_write(40001, 0, &regs[0], &val) < 0 && failures++ < 20)
+        printf("write %d failed\n", v);
+}
+
+int main(void)
+{
+    int ret;
+
+    if ((ret = register_add_table(NULL, regs, 1)) < 0) {
+        printf("register_add_table: %d\n", ret);
+        return 1;
+    }
+    yam_reg_cache_set_policy("sensor", 60000, 0);
+
+    check_read("first read", 100, 1);
+    check_read("cached read", 100, 0);
+    write_value(7);
+    check_read("read after a write", 7, 1);
+    check_read("cached read after a write", 7, 0);
+
+    /* the write isn't seen by the cache, nothing is cached meanwhile */
+    yam_reg_cache_set_policy("sensor", 0, 0);
+    write_value(8);
+    yam_reg_cache_set_policy("sensor", 60000, 0);
+    check_read("read after the policy is set again", 8, 1);
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,96 @@
+/**
+ * @file regindex_table_check.c
+ * @brief Check the runtime tables which collide with the index
+ *
+ * Adds and replaces tables with a ref twice in the table, or refs
+ * overlapping another table: each call has to fail with
+ * -REG_ERR_DATA_VALUE and leave the index as it was, the registers
+ * added before are still found.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. tools/regindex_table_check.c src/register.c \
+ *         src/regindex.c src/regval.c src/regchange.c src/regcache.c \
+ *         src/trace.c -lpthread -o table_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ */
+
+#include <stdio.h>
+#include "yam.h"
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static const reg_t base[] = {
+    { .ref = 40001, .size = 2, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40003, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+static const reg_t twice[] = {
+    { .ref = 40010, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40010, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+/* its first register runs into the base table */
+static const reg_t overlap[] = {
+    { .ref = 40000, .size = 2, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+/* a ref of the base table */
+static const reg_t same_ref[] = {
+    { .ref = 40003, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+static const reg_t other[] = {
+    { .ref = 40020, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+static void check_found(const char *what)
+{
+    const reg_t *reg;
+
+    check(register_find(40001, 0, &reg) == 0 && reg == &base[0],
+            "%s: 40001 lost", what);
+    check(register_find(40003, 0, &reg) == 0 && reg == &base[1],
+            "%s: 40003 lost", what);
+}
+
+int main(void)
+{
+    const reg_t *reg;
+    int id, ret;
+
+    check((ret = register_add_table(NULL, base, 2)) > 0, "add base: %d",
+            ret);
+
+    ret = register_add_table(NULL, twice, 2);
+    check(ret == -REG_ERR_DATA_VALUE, "add a ref twice: %d", ret);
+    check(register_find(40010, 0, &reg) < 0, "40010 added");
+    check_found("ref twice");
+
+    ret = register_add_table(NULL, overlap, 1);
+    check(ret == -REG_ERR_DATA_VALUE, "add an overlap: %d", ret);
+    check_found("overlap");
+
+    ret = register_add_table(NULL, same_ref, 1);
+    check(ret == -REG_ERR_DATA_VALUE, "add a ref of another table: %d",
+            ret);
+    check_found("same ref");
+
+    /* a replace which collides keeps the registers it was to replace */
+    check((id = register_add_table(NULL, other, 1)) > 0, "add other: %d",
+            id);
+    ret = register_replace_table(NULL, id, overlap, 1);
+    check(ret == -REG_ERR_DATA_VALUE, "replace with an overlap: %d", ret);
+    check(register_find(40020, 0, &reg) == 0 && reg == &other[0],
+            "40020 lost");
+    check_found("replace");
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
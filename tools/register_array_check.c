@@ -0,0 +1,273 @@
+/**
+ * @file register_array_check.c
+ * @brief Check the lookup, read and write of array registers
+ *
+ * Adds a table with an array in data and an array with block callbacks
+ * between plain registers, then reads and writes elements in the
+ * middle of the arrays, and ranges which run from an array into the
+ * next array or into a plain register. A block callback returning the
+ * number of elements it wrote succeeds, as any non-negative return.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. -DYAM_REG_ARRAY=1 tools/register_array_check.c \
+ *         src/register.c src/regindex.c src/regval.c src/regchange.c \
+ *         src/regcache.c src/trace.c -lpthread -o array_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "yam.h"
+
+#define SAMPLES     100
+#define BLOCKS      10
+
+static regval_t mem[65536];
+static regval_t samples[SAMPLES];
+static regval_t blocks[BLOCKS];
+static int block_err;
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static int load(regval_t *val, mb_ref_t ref)
+{
+    regval_put_integer(val, mem[ref].n);
+    return 0;
+}
+
+static int save(const regval_t *val, mb_ref_t ref)
+{
+    mem[ref] = *val;
+    return 0;
+}
+
+static const regstore_cb_t store = {
+    .load_register = load,
+    .save_register = save,
+};
+
+static int read_block(const reg_t *reg, unsigned int first, regval_t *vals,
+        unsigned int n)
+{
+    memcpy(vals, blocks + first, n * sizeof(regval_t));
+    return 0;
+}
+
+static int write_block(const reg_t *reg, unsigned int first,
+        const regval_t *vals, unsigned int n)
+{
+    if (block_err) return block_err;
+    memcpy(blocks + first, vals, n * sizeof(regval_t));
+    return n;
+}
+
+static const reg_array_t samples_array = {
+    .count = SAMPLES, .data = samples,
+};
+
+static const reg_array_t blocks_array = {
+    .count = BLOCKS, .read_block = read_block, .write_block = write_block,
+};
+
+static const reg_t regs[] = {
+    { .ref = 40001, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+    { .ref = 40002, .size = 1, .tag = _integer, .perm = REG_PERM_RW,
+        .array = &samples_array },
+    { .ref = 40102, .size = 2, .tag = _float, .perm = REG_PERM_RW,
+        .array = &blocks_array },
+    { .ref = 40122, .size = 1, .tag = _integer, .perm = REG_PERM_RW },
+};
+
+#define SAMPLES_REG (&regs[1])
+#define BLOCKS_REG  (&regs[2])
+
+static void reset(void)
+{
+    int i;
+
+    for (i = 0; i < SAMPLES; ++i) regval_put_integer(&samples[i], 1000 + i);
+    for (i = 0; i < BLOCKS; ++i) regval_put_float(&blocks[i], i + 0.5f);
+    regval_put_integer(&mem[40001], 1);
+    regval_put_integer(&mem[40122], 2);
+}
+
+/**
+ * Read a range and check the registers and the values, expect holds
+ * the value of each ref which starts a register or an element.
+ */
+static void check_read(mb_ref_t start, uint16_t count, int n,
+        const reg_t *const *want_regs, const regval_t *want)
+{
+    const reg_t *got_regs[REG_RANGE_MAX];
+    regval_t vals[REG_RANGE_MAX];
+    char buf[REG_RANGE_MAX * 2], want_buf[REG_RANGE_MAX * 2], *p;
+    int i, ret;
+
+    ret = register_read_range(start, count, got_regs, vals);
+    check(ret == n, "read %u+%u: %d registers, expected %d", start, count,
+            ret, n);
+    for (i = 0; ret == n && i < n; ++i) {
+        check(got_regs[i] == want_regs[i], "read %u+%u: register %d is "
+                "%u, expected %u", start, count, i, got_regs[i]->ref,
+                want_regs[i]->ref);
+        check(vals[i].tag == want[i].tag && vals[i].n == want[i].n,
+                "read %u+%u: value %d is %08lx, expected %08lx", start,
+                count, i, (unsigned long)vals[i].n,
+                (unsigned long)want[i].n);
+    }
+
+    /* the same in modbus order */
+    for (i = 0, p = want_buf; i < n; p += 2 * want_regs[i++]->size)
+        regval_encode_mb(&want[i], p, want[i].tag, want_regs[i]->size,
+                want_regs[i]->mb_scale);
+    ret = register_read_range_mb(start, count, buf);
+    check(! ret && ! memcmp(buf, want_buf, count * 2),
+            "read %u+%u in modbus order: %d", start, count, ret);
+}
+
+static int write_mb(mb_ref_t start, uint16_t count, int n,
+        const reg_t *const *regs, const regval_t *vals)
+{
+    char buf[REG_RANGE_MAX * 2], *p;
+    int i;
+
+    for (i = 0, p = buf; i < n; p += 2 * regs[i++]->size)
+        regval_encode_mb(&vals[i], p, vals[i].tag, regs[i]->size,
+                regs[i]->mb_scale);
+    return register_write_range_mb(start, count, buf);
+}
+
+static void check_lookup(void)
+{
+    const reg_t *found[REG_RANGE_MAX];
+    int ret;
+
+    /* an element in the middle, alone and with the next ones */
+    ret = register_find_range(40050, 1, found);
+    check(ret == 1 && found[0] == SAMPLES_REG, "find 40050: %d", ret);
+    ret = register_find_range(40051, 3, found);
+    check(ret == 3 && found[0] == SAMPLES_REG && found[2] == SAMPLES_REG,
+            "find 40051+3: %d", ret);
+    ret = register_find_range(40110, 2, found);
+    check(ret == 1 && found[0] == BLOCKS_REG, "find 40110+2: %d", ret);
+
+    /* halves of an element, and elements which are not registers */
+    check(register_find_range(40111, 2, found) < 0, "find 40111+2");
+    check(register_find_range(40110, 1, found) < 0, "find 40110+1");
+    check(register_find(40050, 0, found) < 0, "register_find 40050");
+
+    /* from an array into the next one and into a plain register */
+    ret = register_find_range(40100, 4, found);
+    check(ret == 3 && found[1] == SAMPLES_REG && found[2] == BLOCKS_REG,
+            "find 40100+4: %d", ret);
+    ret = register_find_range(40120, 3, found);
+    check(ret == 2 && found[0] == BLOCKS_REG && found[1] == &regs[3],
+            "find 40120+3: %d", ret);
+}
+
+static void check_reads(void)
+{
+    const reg_t *r[4];
+    regval_t v[4];
+
+    reset();
+    r[0] = SAMPLES_REG;
+    v[0] = samples[48];
+    check_read(40050, 1, 1, r, v);
+
+    r[0] = BLOCKS_REG;
+    v[0] = blocks[4];
+    check_read(40110, 2, 1, r, v);
+
+    r[0] = SAMPLES_REG;
+    r[1] = SAMPLES_REG;
+    r[2] = BLOCKS_REG;
+    v[0] = samples[98];
+    v[1] = samples[99];
+    v[2] = blocks[0];
+    check_read(40100, 4, 3, r, v);
+
+    r[0] = BLOCKS_REG;
+    r[1] = BLOCKS_REG;
+    r[2] = &regs[3];
+    v[0] = blocks[8];
+    v[1] = blocks[9];
+    v[2] = mem[40122];
+    check_read(40118, 5, 3, r, v);
+
+    r[0] = &regs[0];
+    r[1] = SAMPLES_REG;
+    v[0] = mem[40001];
+    v[1] = samples[0];
+    check_read(40001, 2, 2, r, v);
+}
+
+static void check_writes(void)
+{
+    const reg_t *r[4];
+    regval_t v[4];
+    int ret;
+
+    /* elements in the middle, the others are kept */
+    reset();
+    r[0] = SAMPLES_REG;
+    r[1] = SAMPLES_REG;
+    regval_put_integer(&v[0], 7);
+    regval_put_integer(&v[1], 8);
+    ret = write_mb(40050, 2, 2, r, v);
+    check(! ret && samples[48].n == 7 && samples[49].n == 8
+            && samples[47].n == 1047 && samples[50].n == 1050,
+            "write 40050+2: %d", ret);
+
+    /* through the block callback into a plain register */
+    r[0] = BLOCKS_REG;
+    r[1] = &regs[3];
+    regval_put_float(&v[0], -2.25f);
+    regval_put_integer(&v[1], 9);
+    ret = write_mb(40120, 3, 2, r, v);
+    check(! ret && blocks[9].f == -2.25f && mem[40122].n == 9
+            && blocks[8].f == 8.5f, "write 40120+3: %d", ret);
+
+    /* from an array in data into the callback one */
+    r[0] = SAMPLES_REG;
+    r[1] = BLOCKS_REG;
+    regval_put_integer(&v[0], 5);
+    regval_put_float(&v[1], 3.0f);
+    ret = write_mb(40101, 3, 2, r, v);
+    check(! ret && samples[99].n == 5 && blocks[0].f == 3.0f,
+            "write 40101+3: %d", ret);
+
+    /* a failed block write fails the request */
+    block_err = -REG_ERR_DATA_VALUE;
+    r[0] = BLOCKS_REG;
+    regval_put_float(&v[0], 1.0f);
+    ret = write_mb(40104, 2, 1, r, v);
+    check(ret < 0 && blocks[1].f == 1.5f, "failed write 40104+2: %d", ret);
+    block_err = 0;
+}
+
+int main(void)
+{
+    int ret;
+
+    register_install_store_cb(&store);
+    if ((ret = register_add_table(NULL, regs, sizeof(regs) / sizeof(regs[0])))
+            < 0) {
+        printf("register_add_table: %d\n", ret);
+        return 1;
+    }
+
+    check_lookup();
+    check_reads();
+    check_writes();
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
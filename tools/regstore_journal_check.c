@@ -0,0 +1,213 @@
+/**
+ * @file regstore_journal_check.c
+ * @brief Check the journal store under concurrent saves and checkpoints
+ *
+ * Threads save their own registers through the journal store at once,
+ * half of them durable and half not, with a checkpoint every few hundred
+ * records so that checkpoints run while saves go on. Every save has to
+ * succeed, and the store reopened has to hold the last value of each
+ * register. The files are then copied as a crash right after a journal
+ * was moved aside would leave them, with the journal still to replay
+ * next to an older image: the copy has to load the same values, and its
+ * next checkpoint has to drop the old journal. Last a save is cut short
+ * by a file size limit: it has to fail without leaving a torn frame
+ * which would hide the next saves from a replay. Build it with
+ * -fsanitize=thread as well to check the store's shared state.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. -DYAM_REGSTORE_JOURNAL=1 tools/regstore_journal_check.c \
+ *         src/regstore_journal.c src/register.c src/regindex.c \
+ *         src/regval.c src/regchange.c src/regcache.c src/trace.c \
+ *         src/frame_tool.c -lpthread -o journal_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ *
+ *     journal_check [image]
+ */
+
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "yam.h"
+#include "src/regstore_journal.h"
+
+#define THREADS     4
+#define SAVES       5000
+#define CHECKPOINT  500
+
+static reg_t regs[THREADS];
+static int save_errors;
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static void *saver(void *arg)
+{
+    const reg_t *reg = arg;
+    regval_t val;
+    int i;
+
+    for (i = 1; i <= SAVES; ++i) {
+        regval_put_integer(&val, i);
+        if (register_write(reg->ref, 0, reg, &val) < 0)
+            __atomic_add_fetch(&save_errors, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    char buf[4096];
+    ssize_t n;
+    int in, out, err = 0;
+
+    if ((in = open(from, O_RDONLY)) < 0) return -1;
+    if ((out = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0) {
+        close(in);
+        return -1;
+    }
+    while ((n = read(in, buf, sizeof(buf))) > 0)
+        if (write(out, buf, n) != n) err = -1;
+    close(in);
+    close(out);
+    return err;
+}
+
+static void check_values(const char *what)
+{
+    const reg_t *reg;
+    regval_t val;
+    int i;
+
+    for (i = 0; i < THREADS; ++i) {
+        val.n = 0;
+        check(register_read(40001 + i, 0, &reg, &val) >= 0 && val.n == SAVES,
+                "%s: register %d is %ld", what, 40001 + i, (long)val.n);
+    }
+}
+
+/**
+ * A save which can write 2 octets of its frame fails, the next one is
+ * replayed after it.
+ */
+static void check_torn_write(const char *path, const char *log)
+{
+    struct rlimit saved, lim;
+    struct stat st;
+    off_t len;
+    const reg_t *reg;
+    regval_t val;
+    int ret;
+
+    if (regstore_journal_open(path, 0) < 0 || stat(log, &st) < 0
+            || getrlimit(RLIMIT_FSIZE, &saved) < 0) {
+        check(0, "torn write: setup failed");
+        return;
+    }
+    signal(SIGXFSZ, SIG_IGN);
+    len = st.st_size;
+    lim = saved;
+    lim.rlim_cur = len + 2;
+    setrlimit(RLIMIT_FSIZE, &lim);
+    regval_put_integer(&val, 1);
+    ret = register_write(40001, 0, &regs[0], &val);
+    setrlimit(RLIMIT_FSIZE, &saved);
+    check(ret < 0, "torn write: save succeeded");
+    check(stat(log, &st) == 0 && st.st_size == len,
+            "torn write: %ld octets left in the journal",
+            (long)(st.st_size - len));
+
+    regval_put_integer(&val, 2);
+    check((ret = register_write(40001, 0, &regs[0], &val)) >= 0,
+            "torn write: next save: %d", ret);
+    regstore_journal_close();
+
+    check(regstore_journal_open(path, 0) == 0
+            && register_read(40001, 0, &reg, &val) >= 0 && val.n == 2,
+            "torn write: %ld after reopen", (long)val.n);
+    regstore_journal_close();
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/yam_journal_check.img";
+    char log[PATH_MAX], crash[PATH_MAX];
+    char crash_log[PATH_MAX + 8], crash_old[PATH_MAX + 8];
+    pthread_t threads[THREADS];
+    int i, ret;
+
+    snprintf(log, sizeof(log), "%s.log", path);
+    snprintf(crash, sizeof(crash), "%s.crash", path);
+    snprintf(crash_log, sizeof(crash_log), "%s.log", crash);
+    snprintf(crash_old, sizeof(crash_old), "%s.log.old", crash);
+    unlink(path);
+    unlink(log);
+
+    for (i = 0; i < THREADS; ++i) {
+        regs[i].ref = 40001 + i;
+        regs[i].size = 1;
+        regs[i].tag = _integer;
+        regs[i].perm = REG_PERM_RW;
+        regs[i].group = i % 2 ? "async" : NULL;
+    }
+    if ((ret = register_add_table(NULL, regs, THREADS)) < 0
+            || regstore_journal_open(path, CHECKPOINT) < 0
+            || regstore_journal_set_durability("async",
+                REGSTORE_JOURNAL_ASYNC) < 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+    register_install_store_cb(&regstore_journal_cb);
+
+    for (i = 0; i < THREADS; ++i)
+        pthread_create(&threads[i], NULL, saver, &regs[i]);
+    for (i = 0; i < THREADS; ++i)
+        pthread_join(threads[i], NULL);
+    check(! save_errors, "%d saves failed", save_errors);
+    check((ret = regstore_journal_sync()) == 0, "sync: %d", ret);
+
+    /* an older image, with the frames since then in a journal moved aside */
+    unlink(crash);
+    unlink(crash_log);
+    unlink(crash_old);
+    check(copy_file(path, crash) == 0 && copy_file(log, crash_old) == 0,
+            "copy of %s failed", path);
+    regstore_journal_close();
+
+    check((ret = regstore_journal_open(path, 0)) == 0, "reopen: %d", ret);
+    check_values("reopened");
+    regstore_journal_close();
+
+    check((ret = regstore_journal_open(crash, 0)) == 0, "crash copy: %d",
+            ret);
+    check_values("crash copy");
+    check((ret = regstore_journal_checkpoint()) == 0, "checkpoint: %d", ret);
+    check(access(crash_old, F_OK) < 0, "%s left after a checkpoint",
+            crash_old);
+    regstore_journal_close();
+
+    check((ret = regstore_journal_open(crash, 0)) == 0, "crash copy: %d",
+            ret);
+    check_values("crash copy checkpointed");
+    regstore_journal_close();
+
+    check_torn_write(path, log);
+
+    unlink(path);
+    unlink(log);
+    unlink(crash);
+    unlink(crash_log);
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file regstore_mmap_check.c
+ * @brief Check the mmap store under concurrent saves
+ *
+ * Threads save their own registers through the mmap store at once,
+ * with a sync interval short enough for the saves to msync now and
+ * then. Every save has to succeed, the explicit sync too, and the image
+ * reopened has to hold the last value of each register. Build it with
+ * -fsanitize=thread as well to check the store's shared state.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. -DYAM_REGSTORE_MMAP=1 tools/regstore_mmap_check.c \
+ *         src/regstore_mmap.c src/register.c src/regindex.c \
+ *         src/regval.c src/regchange.c src/regcache.c src/trace.c \
+ *         -lpthread -o mmap_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ *
+ *     mmap_check [image]
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "yam.h"
+
+#define THREADS     4
+#define SAVES       20000
+
+static reg_t regs[THREADS];
+static int save_errors;
+
+static void *saver(void *arg)
+{
+    const reg_t *reg = arg;
+    regval_t val;
+    int i;
+
+    for (i = 1; i <= SAVES; ++i) {
+        regval_put_integer(&val, i);
+        if (register_write(reg->ref, 0, reg, &val) < 0)
+            __atomic_add_fetch(&save_errors, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/yam_mmap_check.img";
+    pthread_t threads[THREADS];
+    const reg_t *reg;
+    regval_t val;
+    long failures = 0;
+    int i, ret;
+
+    for (i = 0; i < THREADS; ++i) {
+        regs[i].ref = 40001 + i;
+        regs[i].size = 1;
+        regs[i].tag = _integer;
+        regs[i].perm = REG_PERM_RW;
+    }
+    unlink(path);
+    if ((ret = register_add_table(NULL, regs, THREADS)) < 0
+            || regstore_mmap_open(path, 1) < 0) {
+        printf("setup failed\n");
+        return 1;
+    }
+    register_install_store_cb(&regstore_mmap_cb);
+
+    for (i = 0; i < THREADS; ++i)
+        pthread_create(&threads[i], NULL, saver, &regs[i]);
+    for (i = 0; i < THREADS; ++i)
+        pthread_join(threads[i], NULL);
+    if (save_errors) {
+        printf("%d saves failed\n", save_errors);
+        ++failures;
+    }
+    if ((ret = regstore_mmap_sync()) < 0) {
+        printf("sync: %d\n", ret);
+        ++failures;
+    }
+    regstore_mmap_close();
+
+    if ((ret = regstore_mmap_open(path, 1)) != 0) {
+        printf("reopen: %d\n", ret);
+        return 1;
+    }
+    for (i = 0; i < THREADS; ++i)
+        if (register_read(40001 + i, 0, &reg, &val) < 0 || val.n != SAVES) {
+            printf("register %d: %ld after reopen\n", 40001 + i,
+                    (long)val.n);
+            ++failures;
+        }
+    regstore_mmap_close();
+    unlink(path);
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * @file regval_bulk_bench.c
+ * @brief Compare and time the bulk codecs with the per-value ones
+ *
+ * Encodes and decodes runs of random values of the codecs of two and
+ * four registers, unscaled and in every octet order, through
+ * regval_encode_mb_bulk() and regval_decode_mb_bulk(), and compares
+ * each result with the per-value codec: the octets and the values have
+ * to be the same. It then prints the time per value of both, for runs
+ * of a 125-register read:
+ *
+ *     cc -O2 -I. tools/regval_bulk_bench.c src/regval.c -o bulk_bench
+ *
+ * Build it with -mssse3 or for aarch64 to time the vector path, and
+ * without either for the scalar one. Add -DYAM_REG_64BIT=1 to take the
+ * four-register integers as well, and the 16-octet regval_t they need.
+ *
+ *     bulk_bench [runs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "src/regval.h"
+
+#define VALUES      (125 / 2)
+#define RUNS        200000
+
+static long mismatches;
+
+static const int codecs[] = {
+    REGVAL_CODEC_INT32, REGVAL_CODEC_FLOAT32,
+#if YAM_REG_64BIT
+    REGVAL_CODEC_INT64,
+#endif
+};
+
+static const char *const names[] = {
+    [REGVAL_CODEC_INT32] = "int32",
+    [REGVAL_CODEC_FLOAT32] = "float32",
+    [REGVAL_CODEC_INT64] = "int64",
+};
+
+static uint64_t rand64(void)
+{
+    static uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+static void random_values(int codec, regval_t *vals, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; ++i) {
+        uint64_t r = rand64();
+
+#if YAM_REG_64BIT
+        if (codec == REGVAL_CODEC_INT64) regval_put_int64(&vals[i], r);
+        else
+#endif
+        if (codec == REGVAL_CODEC_FLOAT32)
+            regval_put_float(&vals[i], (int32_t)r / 1024.0f);
+        else regval_put_integer(&vals[i], r);
+    }
+}
+
+static int same_value(int codec, const regval_t *a, const regval_t *b)
+{
+    if (a->tag != b->tag) return 0;
+#if YAM_REG_64BIT
+    if (codec == REGVAL_CODEC_INT64) return a->n64 == b->n64;
+#endif
+    return codec == REGVAL_CODEC_FLOAT32 ? ! memcmp(&a->f, &b->f, 4)
+        : a->n == b->n;
+}
+
+/**
+ * Compare the bulk codecs of n values with the per-value ones, n is
+ * taken short of a vector as well to reach the scalar tails.
+ */
+static void compare(int codec, int order, size_t n)
+{
+    static regval_t vals[VALUES], back[VALUES];
+    static char buf[VALUES * 8], ref[VALUES * 8];
+    regval_t one;
+    int w = codec == REGVAL_CODEC_INT64 ? 8 : 4;
+    size_t i;
+
+    random_values(codec, vals, n);
+    for (i = 0; i < n; ++i)
+        regval_encode_mb_codec(codec, order, &vals[i], ref + i * w, 0);
+    regval_encode_mb_bulk(codec, order, vals, n, buf, 0);
+    if (memcmp(buf, ref, n * w) && mismatches++ < 20)
+        printf("%s order %d: %zu values encoded apart\n", names[codec],
+                order, n);
+
+    regval_decode_mb_bulk(codec, order, ref, back, n, 0);
+    for (i = 0; i < n; ++i) {
+        regval_decode_mb_codec(codec, order, ref + i * w, &one, 0);
+        if (! same_value(codec, &back[i], &one) && mismatches++ < 20)
+            printf("%s order %d: value %zu of %zu decoded apart\n",
+                    names[codec], order, i, n);
+    }
+}
+
+static double elapsed_ns(const struct timespec *t0)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0->tv_sec) * 1e9 + (t.tv_nsec - t0->tv_nsec);
+}
+
+static void timing(int codec, long runs)
+{
+    static regval_t vals[VALUES];
+    static char buf[VALUES * 8];
+    double per = (double)runs * VALUES;
+    int w = codec == REGVAL_CODEC_INT64 ? 8 : 4;
+    struct timespec t0;
+    volatile char sink;
+    long k;
+    size_t i;
+
+    random_values(codec, vals, VALUES);
+    printf("%-8s", names[codec]);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < runs; ++k) {
+        for (i = 0; i < VALUES; ++i)
+            regval_encode_mb_codec(codec, REGVAL_ORDER_DEFAULT, &vals[i],
+                    buf + i * w, 0);
+        sink = buf[k % sizeof(buf)];
+    }
+    printf(" encode %.2f ns", elapsed_ns(&t0) / per);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < runs; ++k) {
+        regval_encode_mb_bulk(codec, REGVAL_ORDER_DEFAULT, vals, VALUES,
+                buf, 0);
+        sink = buf[k % sizeof(buf)];
+    }
+    printf(", bulk %.2f ns", elapsed_ns(&t0) / per);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < runs; ++k) {
+        for (i = 0; i < VALUES; ++i)
+            regval_decode_mb_codec(codec, REGVAL_ORDER_DEFAULT, buf + i * w,
+                    &vals[i], 0);
+        sink = vals[k % VALUES].tag;
+    }
+    printf("; decode %.2f ns", elapsed_ns(&t0) / per);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < runs; ++k) {
+        regval_decode_mb_bulk(codec, REGVAL_ORDER_DEFAULT, buf, vals, VALUES,
+                0);
+        sink = vals[k % VALUES].tag;
+    }
+    printf(", bulk %.2f ns\n", elapsed_ns(&t0) / per);
+    (void)sink;
+}
+
+int main(int argc, char **argv)
+{
+    long runs = argc > 1 ? atol(argv[1]) : RUNS;
+    unsigned int c;
+    int order;
+    size_t n;
+
+    for (c = 0; c < sizeof(codecs) / sizeof(codecs[0]); ++c)
+        for (order = REGVAL_ORDER_DEFAULT; order < REGVAL_ORDER_NUM; ++order)
+            for (n = 0; n <= VALUES; ++n)
+                compare(codecs[c], order, n);
+    printf("%ld mismatches, regval_t of %zu octets\n", mismatches,
+            sizeof(regval_t));
+
+    for (c = 0; c < sizeof(codecs) / sizeof(codecs[0]); ++c)
+        timing(codecs[c], runs);
+    return mismatches != 0;
+}
@@ -0,0 +1,217 @@
+/**
+ * @file regval_int64_check.c
+ * @brief Check the four-register codecs
+ *
+ * Checks the octets of _int64, _uint64 and _double values in each
+ * order, one by one and in bulk, and their round trip. Then scales
+ * random 64-bit integers of every magnitude at every mb_scale, with the
+ * edges of the ranges, and compares each result with an exact 128-bit
+ * reference: rounded halves away from zero, saturated where the
+ * multiplication overflows.
+ *
+ *     cc -O2 -I. -DYAM_REG_64BIT=1 tools/regval_int64_check.c \
+ *         src/regval.c -o int64_check
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "src/regval.h"
+
+#define SCALE_MIN   -16
+#define SCALE_MAX   16
+#define PAIRS       400000
+
+static const unsigned char octets[REGVAL_ORDER_NUM][8] = {
+    [REGVAL_ORDER_DEFAULT] = { 1, 2, 3, 4, 5, 6, 7, 8 },
+    [REGVAL_ORDER_B] = { 1, 2, 3, 4, 5, 6, 7, 8 },
+    [REGVAL_ORDER_BB] = { 2, 1, 4, 3, 6, 5, 8, 7 },
+    [REGVAL_ORDER_L] = { 8, 7, 6, 5, 4, 3, 2, 1 },
+    [REGVAL_ORDER_LB] = { 7, 8, 5, 6, 3, 4, 1, 2 },
+};
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static uint64_t rand64(void)
+{
+    static uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+/**
+ * The octets of 0x0102030405060708 in each order, and the same
+ * through the bulk codecs.
+ */
+static void check_orders(void)
+{
+    static const int codecs[] = {
+        REGVAL_CODEC_INT64, REGVAL_CODEC_UINT64,
+#if YAM_REG_DOUBLE
+        REGVAL_CODEC_DOUBLE,
+#endif
+    };
+    unsigned char buf[8 * 3];
+    regval_t vals[3], back[3];
+    unsigned int c;
+    int order, i;
+
+    for (c = 0; c < sizeof(codecs) / sizeof(codecs[0]); ++c)
+        for (order = 0; order < REGVAL_ORDER_NUM; ++order) {
+            for (i = 0; i < 3; ++i) {
+                vals[i].u64 = 0x0102030405060708ULL;
+                vals[i].tag = codecs[c] == REGVAL_CODEC_INT64 ? _int64
+                    : codecs[c] == REGVAL_CODEC_UINT64 ? _uint64 : _double;
+            }
+            memset(buf, 0, sizeof(buf));
+            regval_encode_mb_codec(codecs[c], order, &vals[0], (char *)buf, 0);
+            check(! memcmp(buf, octets[order], 8), "codec %d order %d: "
+                    "%02x%02x%02x%02x%02x%02x%02x%02x", codecs[c], order,
+                    buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6],
+                    buf[7]);
+
+            regval_encode_mb_bulk(codecs[c], order, vals, 3, (char *)buf, 0);
+            for (i = 0; i < 3; ++i)
+                check(! memcmp(buf + 8 * i, octets[order], 8),
+                        "bulk codec %d order %d: value %d", codecs[c], order,
+                        i);
+
+            regval_decode_mb_bulk(codecs[c], order, (const char *)buf, back,
+                    3, 0);
+            for (i = 0; i < 3; ++i)
+                check(back[i].u64 == vals[i].u64 && back[i].tag == vals[i].tag,
+                        "bulk codec %d order %d: value %d came back as %llx",
+                        codecs[c], order, i,
+                        (unsigned long long)back[i].u64);
+        }
+}
+
+/**
+ * val * 10^scale exactly, rounded and saturated to [lo, hi].
+ */
+static __int128 reference(__int128 val, int scale, __int128 lo, __int128 hi)
+{
+    __int128 p = 1, q, r;
+    int k;
+
+    for (k = 0; k < (scale < 0 ? -scale : scale); ++k) p *= 10;
+    if (scale >= 0) {
+        /* |val| < 2^64 and p <= 10^16, the product fits */
+        q = val * p;
+        return q > hi ? hi : q < lo ? lo : q;
+    }
+    q = val / p;
+    r = val % p;
+    if (2 * (r < 0 ? -r : r) >= p) q += val < 0 ? -1 : 1;
+    return q;
+}
+
+static void check_int64(int64_t v, int scale)
+{
+    regval_t val, back;
+    char buf[8];
+    int64_t want;
+
+    /* an encode scales by 10^-scale, a decode by 10^scale */
+    regval_put_int64(&val, v);
+    regval_encode_mb(&val, buf, _int64, 4, scale);
+    back.tag = _int64;
+    regval_decode_mb(buf, &back, _int64, 4, 0);
+    want = reference(v, -scale, INT64_MIN, INT64_MAX);
+    check(back.n64 == want, "int64 %lld encoded at scale %d: %lld, "
+            "expected %lld", (long long)v, scale, (long long)back.n64,
+            (long long)want);
+
+    regval_encode_mb(&val, buf, _int64, 4, 0);
+    regval_decode_mb(buf, &back, _int64, 4, scale);
+    want = reference(v, scale, INT64_MIN, INT64_MAX);
+    check(back.n64 == want && back.tag == _int64, "int64 %lld decoded at "
+            "scale %d: %lld, expected %lld", (long long)v, scale,
+            (long long)back.n64, (long long)want);
+}
+
+static void check_uint64(uint64_t v, int scale)
+{
+    regval_t val, back;
+    char buf[8];
+    uint64_t want;
+
+    regval_put_uint64(&val, v);
+    regval_encode_mb(&val, buf, _uint64, 4, scale);
+    back.tag = _uint64;
+    regval_decode_mb(buf, &back, _uint64, 4, 0);
+    want = reference(v, -scale, 0, UINT64_MAX);
+    check(back.u64 == want, "uint64 %llu encoded at scale %d: %llu, "
+            "expected %llu", (unsigned long long)v, scale,
+            (unsigned long long)back.u64, (unsigned long long)want);
+
+    regval_encode_mb(&val, buf, _uint64, 4, 0);
+    regval_decode_mb(buf, &back, _uint64, 4, scale);
+    want = reference(v, scale, 0, UINT64_MAX);
+    check(back.u64 == want && back.tag == _uint64, "uint64 %llu decoded at "
+            "scale %d: %llu, expected %llu", (unsigned long long)v, scale,
+            (unsigned long long)back.u64, (unsigned long long)want);
+}
+
+#if YAM_REG_DOUBLE
+static void check_double(double d)
+{
+    regval_t val, back;
+    char buf[8];
+
+    regval_put_double(&val, d);
+    regval_encode_mb(&val, buf, _double, 4, 0);
+    back.tag = _double;
+    regval_decode_mb(buf, &back, _double, 4, 0);
+    check(! memcmp(&back.d, &d, sizeof(d)), "double %g came back as %g",
+            d, back.d);
+
+    /* scaled by 10^-2 and back, close enough */
+    regval_encode_mb(&val, buf, _double, 4, 2);
+    regval_decode_mb(buf, &back, _double, 4, 2);
+    check(back.d - d <= 1e-12 * (d < 0 ? -d : d)
+            && d - back.d <= 1e-12 * (d < 0 ? -d : d),
+            "double %g scaled came back as %g", d, back.d);
+}
+#endif
+
+int main(void)
+{
+    static const int64_t edges[] = {
+        0, 1, -1, 5, -5, 49, 50, -50, 922337203685477580LL,
+        922337203685477581LL, -922337203685477580LL, -922337203685477581LL,
+        INT64_MAX, INT64_MAX - 1, INT64_MIN, INT64_MIN + 1,
+    };
+    unsigned int i;
+    int scale;
+    long k;
+    uint64_t r;
+
+    check_orders();
+
+    for (scale = SCALE_MIN; scale <= SCALE_MAX; ++scale)
+        for (i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i) {
+            check_int64(edges[i], scale);
+            check_uint64(edges[i], scale);
+        }
+    for (k = 0; k < PAIRS; ++k) {
+        r = rand64();
+        scale = SCALE_MIN + (int)(rand64() % (SCALE_MAX - SCALE_MIN + 1));
+        check_int64((int64_t)r >> r % 64, scale);
+        check_uint64(r >> r % 64, scale);
+#if YAM_REG_DOUBLE
+        check_double((double)(int64_t)r / (1 + r % 1000));
+#endif
+    }
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,126 @@
+/**
+ * @file regval_roundtrip.c
+ * @brief Exhaustive round trip of the one-register codecs
+ *
+ * Decodes every 16-bit word at every mb_scale, as _integer and as
+ * _float, and encodes the value back. The word has to come back
+ * whenever the value holds it exactly: always for floats, and for
+ * integers when w * 10^scale is an integer in the int32 range. A word
+ * is read as an int16 whatever the signedness of char, so an unscaled
+ * word comes back as -32768..32767. Then values past the 16-bit limits
+ * are encoded: they have to clamp to INT16_MIN or UINT16_MAX, and the
+ * negative ones in range have to come back.
+ *
+ *     cc -O2 -I. tools/regval_roundtrip.c src/regval.c -o regval_roundtrip
+ *
+ * Add -DYAM_REG_FIXED_POINT_SCALING=1 to check the integer-only
+ * scaling, and -fsigned-char or -funsigned-char to check both.
+ */
+
+#include <stdio.h>
+#include "src/regval.h"
+
+#define SCALE_MIN   -16
+#define SCALE_MAX   16
+
+static long failures;
+
+static void fail(const char *what, unsigned int w, int scale,
+        unsigned int back)
+{
+    if (failures++ < 20)
+        printf("%s: word 0x%04x scale %d came back as 0x%04x\n",
+                what, w, scale, back);
+}
+
+/**
+ * Tell if w * 10^scale is an integer in the int32 range.
+ */
+static int exact_integer(int w, int scale)
+{
+    long long v = w;
+    int k;
+
+    for (k = 0; k < scale; ++k)
+        if ((v *= 10) > INT32_MAX || v < INT32_MIN) return 0;
+    for (k = 0; k > scale; --k) {
+        if (v % 10) return 0;
+        v /= 10;
+    }
+    return 1;
+}
+
+static void check(type_tag_t tag, unsigned int w, int scale)
+{
+    unsigned char in[2] = { w >> 8, w }, out[2];
+    regval_t val;
+    unsigned int back;
+
+    val.tag = tag;
+    regval_decode_mb((const char *)in, &val, tag, 1, scale);
+    if (tag == _integer && ! scale && val.n != (int16_t)w)
+        fail("integer read", w, scale, val.n & 0xffff);
+
+    if (tag == _integer && ! exact_integer((int16_t)w, scale)) return;
+    regval_encode_mb(&val, (char *)out, tag, 1, scale);
+    back = out[0] << 8 | out[1];
+    if (back != w) fail(tag == _integer ? "integer" : "float", w, scale, back);
+}
+
+/**
+ * Encode v unscaled, as _integer and as _float, expecting the word want,
+ * and decode it back expecting v if it's in range.
+ */
+static void check_limit(int32_t v, unsigned int want)
+{
+    unsigned char out[2];
+    regval_t val;
+    unsigned int back;
+    int in_range = v >= INT16_MIN && v <= INT16_MAX;
+
+    regval_put_integer(&val, v);
+    regval_encode_mb(&val, (char *)out, _integer, 1, 0);
+    back = out[0] << 8 | out[1];
+    if (back != want && failures++ < 20)
+        printf("integer %ld encoded as 0x%04x\n", (long)v, back);
+    regval_decode_mb((const char *)out, &val, _integer, 1, 0);
+    if (in_range && val.n != v && failures++ < 20)
+        printf("integer %ld came back as %ld\n", (long)v, (long)val.n);
+
+    regval_put_float(&val, v);
+    regval_encode_mb(&val, (char *)out, _float, 1, 0);
+    back = out[0] << 8 | out[1];
+    if (back != want && failures++ < 20)
+        printf("float %ld encoded as 0x%04x\n", (long)v, back);
+    regval_decode_mb((const char *)out, &val, _float, 1, 0);
+    if (in_range && val.f != v && failures++ < 20)
+        printf("float %ld came back as %g\n", (long)v, val.f);
+}
+
+int main(void)
+{
+    unsigned int w;
+    int scale;
+
+    for (scale = SCALE_MIN; scale <= SCALE_MAX; ++scale)
+        for (w = 0; w <= 0xffff; ++w) {
+            check(_integer, w, scale);
+            check(_float, w, scale);
+        }
+
+    check_limit(-5, 0xfffb);
+    check_limit(-1, 0xffff);
+    check_limit(INT16_MIN, 0x8000);
+    check_limit(INT16_MIN - 1, 0x8000);
+    check_limit(-100000, 0x8000);
+    check_limit(INT32_MIN, 0x8000);
+    check_limit(INT16_MAX, 0x7fff);
+    check_limit(UINT16_MAX, 0xffff);
+    check_limit(UINT16_MAX + 1, 0xffff);
+    check_limit(70000, 0xffff);
+    check_limit(INT32_MAX, 0xffff);
+
+    printf("%ld failures in %d words x %d scales\n", failures, 0x10000,
+            SCALE_MAX - SCALE_MIN + 1);
+    return failures != 0;
+}
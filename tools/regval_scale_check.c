@@ -0,0 +1,155 @@
+/**
+ * @file regval_scale_check.c
+ * @brief Compare and time the mb_scale scaling of integer registers
+ *
+ * Scales random int32 values and the edges of the range, at every
+ * mb_scale, through the two-register integer codec, and compares each
+ * result with an exact reference: val * 10^scale rounded halves away
+ * from zero and saturated to int32. Build it once with each scaling,
+ * both have to report no mismatch, then they agree with each other:
+ *
+ *     cc -O2 -I. tools/regval_scale_check.c src/regval.c -o scale_double
+ *     cc -O2 -I. -DYAM_REG_FIXED_POINT_SCALING=1 \
+ *         tools/regval_scale_check.c src/regval.c -o scale_fixed
+ *
+ * It then prints the time of an encode and a decode, for a soft-float
+ * target run it there, e.g., with -mfloat-abi=soft.
+ *
+ *     scale_double [pairs]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "src/regval.h"
+
+#define SCALE_MIN   -16
+#define SCALE_MAX   16
+#define PAIRS       400000
+#define RUNS        2000000
+
+static const int32_t edges[] = {
+    0, 1, -1, 5, -5, 15, -15, 49, 50, -50, 51, 99999, 100000, -149999,
+    214748364, 214748365, -214748365, -214748366,
+    INT32_MAX, INT32_MAX - 1, INT32_MIN, INT32_MIN + 1,
+};
+
+static uint64_t rand64(void)
+{
+    static uint64_t x = 0x9e3779b97f4a7c15ULL;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return x;
+}
+
+static int32_t random_value(void)
+{
+    uint64_t r = rand64();
+
+    /* values of every magnitude, not only the large ones */
+    return (int32_t)(uint32_t)r >> (r >> 32) % 32;
+}
+
+/**
+ * val * 10^scale exactly, rounded and saturated.
+ */
+static int32_t reference(int32_t val, int scale)
+{
+    int64_t v = val, p = 1, q, r;
+    int k;
+
+    for (k = 0; k < (scale < 0 ? -scale : scale); ++k) p *= 10;
+    if (scale >= 0) {
+        if (v && (v > 0 ? v : -v) > ((int64_t)INT32_MAX + 1) / p)
+            return val > 0 ? INT32_MAX : INT32_MIN;
+        v *= p;
+        return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : v;
+    }
+    q = v / p;
+    r = v % p;
+    if (2 * (r < 0 ? -r : r) >= p) q += v < 0 ? -1 : 1;
+    return q;
+}
+
+static int32_t decode(int32_t n, int scale)
+{
+    uint32_t u = n;
+    char buf[4] = { u >> 24, u >> 16, u >> 8, u };
+    regval_t val = { .tag = _integer };
+
+    regval_decode_mb_codec(REGVAL_CODEC_INT32, REGVAL_ORDER_B, buf, &val,
+            scale);
+    return val.n;
+}
+
+static int32_t encode(int32_t n, int scale)
+{
+    unsigned char buf[4];
+    regval_t val;
+
+    regval_put_integer(&val, n);
+    regval_encode_mb_codec(REGVAL_CODEC_INT32, REGVAL_ORDER_B, &val,
+            (char *)buf, scale);
+    return (int32_t)((uint32_t)buf[0] << 24 | buf[1] << 16 | buf[2] << 8
+            | buf[3]);
+}
+
+static long mismatches;
+
+static void compare(int32_t val, int scale)
+{
+    int32_t got;
+
+    /* a decode scales by 10^scale, an encode by 10^-scale */
+    if ((got = decode(val, scale)) != reference(val, scale)
+            && mismatches++ < 20)
+        printf("decode %ld scale %d: %ld, expected %ld\n", (long)val, scale,
+                (long)got, (long)reference(val, scale));
+    if ((got = encode(val, scale)) != reference(val, -scale)
+            && mismatches++ < 20)
+        printf("encode %ld scale %d: %ld, expected %ld\n", (long)val, scale,
+                (long)got, (long)reference(val, -scale));
+}
+
+static double elapsed_ns(const struct timespec *t0)
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec - t0->tv_sec) * 1e9 + (t.tv_nsec - t0->tv_nsec);
+}
+
+int main(int argc, char **argv)
+{
+    static int32_t vals[1024];
+    long pairs = argc > 1 ? atol(argv[1]) : PAIRS;
+    struct timespec t0;
+    volatile int32_t sink = 0;
+    unsigned int i;
+    int scale;
+    long k;
+
+    for (scale = SCALE_MIN; scale <= SCALE_MAX; ++scale)
+        for (i = 0; i < sizeof(edges) / sizeof(edges[0]); ++i)
+            compare(edges[i], scale);
+    for (k = 0; k < pairs; ++k)
+        compare(random_value(),
+                SCALE_MIN + (int)(rand64() % (SCALE_MAX - SCALE_MIN + 1)));
+
+    printf("%s scaling: %ld mismatches in %ld random pairs and the edges\n",
+            YAM_REG_FIXED_POINT_SCALING ? "fixed-point" : "double",
+            mismatches, pairs);
+
+    for (i = 0; i < 1024; ++i) vals[i] = random_value();
+    for (scale = -2; scale <= 2; scale += 2) {
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (k = 0; k < RUNS; ++k) sink += decode(vals[k % 1024], scale);
+        printf("scale %2d: decode %.1f ns", scale, elapsed_ns(&t0) / RUNS);
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (k = 0; k < RUNS; ++k) sink += encode(vals[k % 1024], scale);
+        printf(", encode %.1f ns\n", elapsed_ns(&t0) / RUNS);
+    }
+    return mismatches != 0;
+}
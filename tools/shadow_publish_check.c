@@ -0,0 +1,86 @@
+/**
+ * @file shadow_publish_check.c
+ * @brief Check the shadow image under concurrent publishes
+ *
+ * Threads publish and unpublish their own registers at once, the
+ * registers share the words of the shadow bitmaps. Each thread ends with
+ * its register published: a shadow read of all of them then has to
+ * succeed with the last value of each, no bit lost to another thread's
+ * update. Build it with -fsanitize=thread as well.
+ *
+ * The .register section is left empty, the build defines its bounds:
+ *
+ *     cc -O2 -I. -DYAM_REG_SHADOW=1 -DYAM_REG_SNAPSHOT_READ=1 \
+ *         tools/shadow_publish_check.c src/register.c src/regindex.c \
+ *         src/regval.c src/regchange.c src/regcache.c src/trace.c \
+ *         -lpthread -o shadow_check \
+ *         -Wl,--defsym=__register_start=0,--defsym=__register_end=0
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include "yam.h"
+
+#define THREADS     8
+#define ROUNDS      20000
+
+static reg_t regs[THREADS];
+static int publish_errors;
+
+static long failures;
+
+#define check(cond, ...) do { \
+    if (! (cond) && failures++ < 20) { \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+    } } while (0)
+
+static void *publisher(void *arg)
+{
+    const reg_t *reg = arg;
+    regval_t val;
+    int i;
+
+    for (i = 1; i <= ROUNDS; ++i) {
+        regval_put_integer(&val, i);
+        if (yam_reg_publish(reg->ref, &val) < 0)
+            __atomic_add_fetch(&publish_errors, 1, __ATOMIC_RELAXED);
+        if (i < ROUNDS) yam_reg_unpublish(reg->ref);
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t threads[THREADS];
+    unsigned char buf[THREADS * 2];
+    int i, ret;
+
+    for (i = 0; i < THREADS; ++i) {
+        regs[i].ref = YAM_REG_SHADOW_REF_FIRST + i;
+        regs[i].size = 1;
+        regs[i].tag = _integer;
+        regs[i].perm = REG_PERM_RW;
+    }
+    if ((ret = register_add_table(NULL, regs, THREADS)) < 0) {
+        printf("register_add_table: %d\n", ret);
+        return 1;
+    }
+
+    for (i = 0; i < THREADS; ++i)
+        pthread_create(&threads[i], NULL, publisher, &regs[i]);
+    for (i = 0; i < THREADS; ++i)
+        pthread_join(threads[i], NULL);
+    check(! publish_errors, "%d publishes failed", publish_errors);
+
+    ret = register_shadow_read(YAM_REG_SHADOW_REF_FIRST, THREADS,
+            (char *)buf);
+    check(! ret, "shadow read: %d", ret);
+    for (i = 0; ! ret && i < THREADS; ++i)
+        check((buf[2 * i] << 8 | buf[2 * i + 1]) == ROUNDS % 65536,
+                "register %d: %02x%02x", regs[i].ref, buf[2 * i],
+                buf[2 * i + 1]);
+
+    printf("%ld failures\n", failures);
+    return failures != 0;
+}
@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""
+Decode a dump of yam_trace_dump() (see src/trace.h).
+
+Prints per-stage latencies and the latency of the whole request, and
+optionally writes Chrome trace JSON, to be opened in chrome://tracing
+or Perfetto.
+
+    trace_decode.py trace.bin [--chrome trace.json]
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+MAGIC = 0x54524159
+VERSION = 1
+
+STAGES = [
+    "request",
+    "ring_drain",
+    "crc_check",
+    "dispatch",
+    "reg_find",
+    "store",
+    "encode",
+    "decode",
+    "crc_sign",
+    "send",
+]
+
+FILE_HDR = struct.Struct("<IHHII")
+RING_HDR = struct.Struct("<IIQ")
+REC = struct.Struct("<QIBBH")
+
+BEGIN, END = 0, 1
+
+
+def stage_name(stage):
+    return STAGES[stage] if stage < len(STAGES) else "stage%d" % stage
+
+
+def load(path):
+    """Return [(thread, lost, [(ts, req, stage, phase, arg)])]."""
+    with open(path, "rb") as f:
+        data = f.read()
+
+    magic, version, rec_size, stages, nrings = FILE_HDR.unpack_from(data, 0)
+    if magic != MAGIC:
+        sys.exit("%s: not a trace dump" % path)
+    if version != VERSION or rec_size != REC.size:
+        sys.exit("%s: trace version %d, record size %d not supported"
+                 % (path, version, rec_size))
+    if stages != len(STAGES):
+        print("warning: %d stages in the dump, %d known"
+              % (stages, len(STAGES)), file=sys.stderr)
+
+    off = FILE_HDR.size
+    rings = []
+    for _ in range(nrings):
+        thread, n, lost = RING_HDR.unpack_from(data, off)
+        off += RING_HDR.size
+        recs = [REC.unpack_from(data, off + i * REC.size) for i in range(n)]
+        off += n * REC.size
+        rings.append((thread, lost, recs))
+    return rings
+
+
+def spans(recs):
+    """
+    Pair the begin and end marks of a thread, yield
+    (stage, req, arg, begin, end). The marks of the oldest records
+    may have lost their begin, they are skipped.
+    """
+    open_ = {}
+    for ts, req, stage, phase, arg in recs:
+        if phase == BEGIN:
+            open_.setdefault(stage, []).append((ts, req, arg))
+        elif open_.get(stage):
+            begin, req, arg = open_[stage].pop()
+            yield stage, req, arg, begin, ts
+
+
+def percentile(sorted_vals, p):
+    i = min(len(sorted_vals) - 1, int(len(sorted_vals) * p / 100.0))
+    return sorted_vals[i]
+
+
+def report(rings, out):
+    lat = {}
+    for _, _, recs in rings:
+        for stage, _, _, begin, end in spans(recs):
+            lat.setdefault(stage, []).append(end - begin)
+
+    out.write("%-12s %8s %10s %10s %10s %10s %8s\n"
+              % ("stage", "count", "mean us", "p50 us", "p99 us", "max us",
+                 "share"))
+    # shares of the time spent in whole requests, if any were traced
+    total = sum(lat.get(0, []))
+    for stage in sorted(lat):
+        v = sorted(lat[stage])
+        share = "%7.1f%%" % (100.0 * sum(v) / total) if total else "-"
+        out.write("%-12s %8d %10.2f %10.2f %10.2f %10.2f %8s\n"
+                  % (stage_name(stage), len(v), sum(v) / len(v) / 1e3,
+                     percentile(v, 50) / 1e3, percentile(v, 99) / 1e3,
+                     v[-1] / 1e3, share))
+
+    for thread, lost, _ in rings:
+        if lost:
+            out.write("thread %d: %d records overwritten\n" % (thread, lost))
+
+
+def chrome(rings, path):
+    events = []
+    for thread, _, recs in rings:
+        for ts, req, stage, phase, arg in recs:
+            events.append({
+                "name": stage_name(stage),
+                "ph": "B" if phase == BEGIN else "E",
+                "ts": ts / 1e3,
+                "pid": 0,
+                "tid": thread,
+                "args": {"req": req, "arg": arg},
+            })
+    with open(path, "w") as f:
+        json.dump({"traceEvents": events, "displayTimeUnit": "ns"}, f)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.strip().splitlines()[0])
+    ap.add_argument("dump", help="file written by yam_trace_dump()")
+    ap.add_argument("--chrome", metavar="JSON",
+                    help="also write Chrome trace JSON")
+    args = ap.parse_args()
+
+    rings = load(args.dump)
+    report(rings, sys.stdout)
+    if args.chrome:
+        chrome(rings, args.chrome)
+
+
+if __name__ == "__main__":
+    main()
@@ -8,6 +8,18 @@
 #include "src/err.h"
 #include "src/regval.h"
 #include "src/register.h"
+#include "src/regindex.h"
+#include "src/regchange.h"
+#include "src/regbits.h"
+#include "src/regprof.h"
+#include "src/regcache.h"
+#include "src/trace.h"
+#if YAM_REGSTORE_MMAP
+#include "src/regstore_mmap.h"
+#endif
+#if YAM_REGSTORE_JOURNAL
+#include "src/regstore_journal.h"
+#endif
 #include "src/filetype.h"
 #include "src/record-file.h"
 #include "src/appl.h"